@@ -54,9 +54,10 @@ binit(void)
 
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
-// In either case, return locked buffer.
+// In either case, return locked buffer, shared
+// with other readers if shared is set.
 static struct buf*
-bget(uint dev, uint blockno)
+bget(uint dev, uint blockno, int shared)
 {
   struct buf *b;
 
@@ -67,7 +68,10 @@ bget(uint dev, uint blockno)
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
       release(&bcache.lock);
-      acquiresleep(&b->lock);
+      if(shared)
+        acquiresleepshared(&b->lock);
+      else
+        acquiresleep(&b->lock);
       return b;
     }
   }
@@ -81,7 +85,10 @@ bget(uint dev, uint blockno)
       b->valid = 0;
       b->refcnt = 1;
       release(&bcache.lock);
-      acquiresleep(&b->lock);
+      if(shared)
+        acquiresleepshared(&b->lock);
+      else
+        acquiresleep(&b->lock);
       return b;
     }
   }
@@ -94,33 +101,82 @@ bread(uint dev, uint blockno)
 {
   struct buf *b;
 
-  b = bget(dev, blockno);
+  b = bget(dev, blockno, 0);
   if(!b->valid) {
-    virtio_disk_rw(b, 0);
+    iorw(b, 0);
     b->valid = 1;
   }
   return b;
 }
 
+// Return a locked buf for the indicated block without
+// reading it, for a caller that will overwrite all of it.
+struct buf*
+bblank(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno, 0);
+  b->valid = 1;
+  return b;
+}
+
+// Like bread(), but the buffer is locked shared, so other
+// readers of the block can use it at the same time. The
+// caller must not modify it, and releases it with
+// brelseshared().
+struct buf*
+breadshared(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno, 1);
+  if(!b->valid) {
+    // Filling the buffer needs it exclusively. Our reference
+    // keeps it from being recycled meanwhile, and once valid
+    // it stays valid.
+    releasesleepshared(&b->lock);
+    acquiresleep(&b->lock);
+    if(!b->valid) {
+      iorw(b, 0);
+      b->valid = 1;
+    }
+    releasesleep(&b->lock);
+    acquiresleepshared(&b->lock);
+  }
+  return b;
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
-  virtio_disk_rw(b, 1);
+  iorw(b, 1);
 }
 
-// Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Write the n buffers in b[] to disk, all at once so
+// that the disk scheduler can merge them. Must be locked.
 void
-brelse(struct buf *b)
+bwritev(struct buf **b, int n)
 {
-  if(!holdingsleep(&b->lock))
-    panic("brelse");
+  int i;
 
-  releasesleep(&b->lock);
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&b[i]->lock))
+      panic("bwritev");
+    iosubmit(b[i], 1);
+  }
+  for(i = 0; i < n; i++)
+    iowait(b[i]);
+}
 
+// Drop a reference to an unlocked buffer.
+// Move to the head of the most-recently-used list.
+static void
+bput(struct buf *b)
+{
   acquire(&bcache.lock);
   b->refcnt--;
   if (b->refcnt == 0) {
@@ -136,6 +192,25 @@ brelse(struct buf *b)
   release(&bcache.lock);
 }
 
+// Release a locked buffer.
+void
+brelse(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("brelse");
+
+  releasesleep(&b->lock);
+  bput(b);
+}
+
+// Release a buffer from breadshared().
+void
+brelseshared(struct buf *b)
+{
+  releasesleepshared(&b->lock);
+  bput(b);
+}
+
 void
 bpin(struct buf *b) {
   acquire(&bcache.lock);
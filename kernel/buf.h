@@ -7,6 +7,8 @@ struct buf {
   uint refcnt;
   struct buf *prev; // LRU cache list
   struct buf *next;
+  struct buf *qnext; // iosched queue
+  int qwrite;        // queued for writing, not reading
   uchar data[BSIZE];
 };
 
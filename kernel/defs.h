@@ -2,10 +2,18 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct iovec;
+struct memstat;
+struct swapstat;
+struct lockstat;
+struct logstat;
+struct diskstat;
 struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
+struct slabcache;
+struct spawnact;
 struct stat;
 struct superblock;
 
@@ -13,9 +21,21 @@ struct superblock;
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
+struct buf*     breadshared(uint, uint);
+void            brelseshared(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+void            bwritev(struct buf**, int);
+struct buf*     bblank(uint, uint);
+
+// iosched.c
+void            ioschedinit(void);
+void            iosubmit(struct buf*, int);
+void            iowait(struct buf*);
+void            iorw(struct buf*, int);
+void            iodone(struct buf**, int);
+void            iostat(struct diskstat*);
 
 // console.c
 void            consoleinit(void);
@@ -24,6 +44,7 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+int             execproc(struct proc*, char*, char**);
 
 // file.c
 struct file*    filealloc(void);
@@ -33,6 +54,10 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filereadv(struct file*, struct iovec*, int);
+int             filewritev(struct file*, struct iovec*, int);
+int             filepread(struct file*, uint64, int, uint);
+int             filepwrite(struct file*, uint64, int, uint);
 
 // fs.c
 void            fsinit(int);
@@ -45,6 +70,9 @@ void            ilock(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
+void            ilockshared(struct inode*);
+void            iunlockshared(struct inode*);
+void            iunlockputshared(struct inode*);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
@@ -62,18 +90,29 @@ void            ramdiskrw(struct buf*);
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
+void            kref(void *);
+void*           kallocpages(int);
+void            kfreepages(void *, int);
+uint64          nfreepages(void);
+void            kallocstat(struct memstat*);
 void            kinit(void);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
+void            begin_opn(int);
+int             logsize(void);
+void            logstat(struct logstat*);
 void            end_op(void);
+void            log_force(void);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
+int             pipereadv(struct pipe*, struct iovec*, int);
 int             pipewrite(struct pipe*, uint64, int);
 
 // printf.c
@@ -85,7 +124,17 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
-int             growproc(int);
+int             vfork(void);
+void            vforkdone(struct proc*, uint64);
+int             spawn(char*, char**, struct spawnact*, int);
+int             clone(uint64, uint64, uint64);
+int             join(int, uint64);
+int             futexwait(uint64, int);
+int             futexwake(uint64, int);
+int             uspaceleave(struct proc*, pagetable_t);
+int             uspaceshared(struct proc*);
+void            uspacedrop(struct proc*);
+int             growproc(int, uint64*);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
@@ -101,6 +150,7 @@ void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
 void            yield(void);
+void            kthreadcreate(void (*)(void), char*);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
@@ -113,13 +163,38 @@ void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
+int             lockstat(int, struct lockstat*);
 void            push_off(void);
 void            pop_off(void);
 
+// shm.c
+void            shminit(void);
+uint64          shmattach(char*, int, uint64);
+int             shmdetach(uint64);
+void            shmdetachall(struct proc*, pagetable_t);
+int             shmfork(struct proc*, struct proc*);
+
+// slab.c
+void            initslab(struct slabcache*, char*, uint);
+void*           slaballoc(struct slabcache*);
+void            slabfree(struct slabcache*, void*);
+int             slabreclaim(void);
+
+// swap.c
+void            swapinit(int, struct superblock*);
+void            swapfree(uint64);
+void            swapkick(void);
+void*           kallocwait(void);
+int             swapin(pagetable_t, uint64);
+void            swapstat(struct swapstat*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
+void            acquiresleepshared(struct sleeplock*);
+void            releasesleepshared(struct sleeplock*);
+int             holdingsleepshared(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
 // string.c
@@ -131,6 +206,12 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// sysfile.c
+struct file*    fdfile(int);
+int             fdopen(char*, int);
+struct file*    fileopen(char*, int);
+int             fdclose(int);
+
 // syscall.c
 int             argint(int, int*);
 int             argstr(int, char*, int);
@@ -156,7 +237,6 @@ int             uartgetc(void);
 // vm.c
 void            kvminit(void);
 void            kvminithart(void);
-uint64          kvmpa(uint64);
 void            kvmmap(uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
@@ -168,6 +248,10 @@ void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
 uint64          walkaddr(pagetable_t, uint64);
+uint64          walkaddrin(pagetable_t, uint64);
+pte_t*          walk(pagetable_t, uint64, int);
+pte_t*          walkleaf(pagetable_t, uint64, int*);
+int             uvmdemote(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
@@ -180,7 +264,7 @@ void            plic_complete(int);
 
 // virtio_disk.c
 void            virtio_disk_init(void);
-void            virtio_disk_rw(struct buf *, int);
+int             virtio_disk_start(struct buf **, int, int);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
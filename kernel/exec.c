@@ -11,6 +11,15 @@ static int loadseg(pde_t *pgdir, uint64 addr, struct inode *ip, uint offset, uin
 
 int
 exec(char *path, char **argv)
+{
+  return execproc(myproc(), path, argv);
+}
+
+// Replace p's user memory with the program in path,
+// for exec(), or for spawn() to fill in a new process.
+// Returns argc, or -1 if p's memory is unchanged.
+int
+execproc(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
   int i, off;
@@ -19,7 +28,10 @@ exec(char *path, char **argv)
   struct inode *ip;
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
-  struct proc *p = myproc();
+
+  // the other threads would be left without memory.
+  if(uspaceshared(p))
+    return -1;
 
   begin_op();
 
@@ -27,7 +39,7 @@ exec(char *path, char **argv)
     end_op();
     return -1;
   }
-  ilock(ip);
+  ilockshared(ip);
 
   // Check ELF header
   if(readi(ip, 0, (uint64)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -57,11 +69,10 @@ exec(char *path, char **argv)
     if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
   }
-  iunlockput(ip);
+  iunlockputshared(ip);
   end_op();
   ip = 0;
 
-  p = myproc();
   uint64 oldsz = p->sz;
 
   // Allocate two pages at the next page boundary.
@@ -114,7 +125,15 @@ exec(char *path, char **argv)
   p->sz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
-  proc_freepagetable(oldpagetable, oldsz);
+  p->ring = 0;           // freed with the old page table
+  if(p->vforkparent)
+    vforkdone(p, oldsz);  // the old page table was borrowed
+  else {
+    shmdetachall(p, oldpagetable);
+    if(p->uspace)
+      uspaceleave(p, oldpagetable);  // p is its only member
+    proc_freepagetable(oldpagetable, oldsz);
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -122,7 +141,7 @@ exec(char *path, char **argv)
   if(pagetable)
     proc_freepagetable(pagetable, sz);
   if(ip){
-    iunlockput(ip);
+    iunlockputshared(ip);
     end_op();
   }
   return -1;
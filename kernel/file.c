@@ -12,35 +12,37 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "slab.h"
+#include "uio.h"
 
 struct devsw devsw[NDEV];
+
+// Open files are allocated from a slab cache; ftable.lock
+// protects their reference counts.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  struct slabcache cache;
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  initslab(&ftable.cache, "file", sizeof(struct file));
 }
 
 // Allocate a file structure.
+// Returns 0 if out of memory.
 struct file*
 filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return 0;
+  if((f = slaballoc(&ftable.cache)) == 0)
+    return 0;
+  f->ref = 1;
+  initsleeplock(&f->offlock, "fileoff");
+  return f;
 }
 
 // Increment ref count for file f.
@@ -72,6 +74,7 @@ fileclose(struct file *f)
   f->ref = 0;
   f->type = FD_NONE;
   release(&ftable.lock);
+  slabfree(&ftable.cache, f);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
@@ -91,9 +94,9 @@ filestat(struct file *f, uint64 addr)
   struct stat st;
   
   if(f->type == FD_INODE || f->type == FD_DEVICE){
-    ilock(f->ip);
+    ilockshared(f->ip);
     stati(f->ip, &st);
-    iunlock(f->ip);
+    iunlockshared(f->ip);
     if(copyout(p->pagetable, addr, (char *)&st, sizeof(st)) < 0)
       return -1;
     return 0;
@@ -101,11 +104,139 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// Read from inode ip at *off into the user buffers in iov,
+// advancing *off. Stops early at end of file.
+static int
+inoderead(struct inode *ip, struct iovec *iov, int iovcnt, uint *off)
+{
+  int i, r, tot;
+
+  tot = 0;
+  ilockshared(ip);
+  for(i = 0; i < iovcnt; i++){
+    r = readi(ip, 1, (uint64)iov[i].iov_base, *off, iov[i].iov_len);
+    if(r > 0){
+      *off += r;
+      tot += r;
+    }
+    if(r != iov[i].iov_len)
+      break;
+  }
+  iunlockshared(ip);
+  return tot;
+}
+
+// Write the user buffers in iov to inode ip at *off,
+// advancing *off. Returns -1 unless everything was written.
+static int
+inodewrite(struct inode *ip, struct iovec *iov, int iovcnt, uint *off)
+{
+  // write as much at a time as a log transaction can
+  // hold, reserving log space in proportion: for each
+  // data block, the block and perhaps a bitmap block,
+  // plus the i-node, the indirect block, and 2 blocks
+  // of slop for non-aligned writes. this really belongs
+  // lower down, since writei() might be writing a device
+  // like the console. small buffers share a transaction
+  // as long as they fit.
+  int max = ((logsize()-1-1-2) / 2) * BSIZE;
+  int i = 0, done = 0, tot = 0, r = 0;
+  uint64 left;
+
+  while(i < iovcnt){
+    left = (uint64)iov[i].iov_len - done;
+    for(int j = i+1; j < iovcnt && left < max; j++)
+      left += iov[j].iov_len;
+    if(left > max)
+      left = max;
+
+    begin_opn(2*((left + BSIZE-1) / BSIZE) + 4);
+    ilock(ip);
+    for(int room = max; i < iovcnt && room > 0; room -= r){
+      int n1 = iov[i].iov_len - done;
+      if(n1 > room)
+        n1 = room;
+      if((r = writei(ip, 1, (uint64)iov[i].iov_base + done, *off, n1)) < 0)
+        break;
+      if(r != n1)
+        panic("short filewrite");
+      *off += r;
+      tot += r;
+      if((done += r) == iov[i].iov_len){
+        i++;
+        done = 0;
+      }
+    }
+    iunlock(ip);
+    end_op();
+
+    if(r < 0)
+      return -1;
+  }
+  return tot;
+}
+
+// Read from file f into the iovcnt user buffers in iov.
+int
+filereadv(struct file *f, struct iovec *iov, int iovcnt)
+{
+  int i, r;
+
+  if(f->readable == 0)
+    return -1;
+
+  if(f->type == FD_INODE){
+    // ip->lock is shared with other readers of the file,
+    // so f->off needs a lock of its own.
+    acquiresleep(&f->offlock);
+    r = inoderead(f->ip, iov, iovcnt, &f->off);
+    releasesleep(&f->offlock);
+    return r;
+  }
+
+  if(f->type == FD_PIPE)
+    return pipereadv(f->pipe, iov, iovcnt);
+
+  // a device read would block once the device has nothing
+  // more, so stop after the first one that returns anything.
+  for(i = 0; i < iovcnt; i++){
+    if((r = fileread(f, (uint64)iov[i].iov_base, iov[i].iov_len)) != 0)
+      return r;
+  }
+  return 0;
+}
+
+// Write the iovcnt user buffers in iov to file f.
+int
+filewritev(struct file *f, struct iovec *iov, int iovcnt)
+{
+  int i, r, tot;
+
+  if(f->writable == 0)
+    return -1;
+
+  if(f->type == FD_INODE){
+    acquiresleep(&f->offlock);
+    r = inodewrite(f->ip, iov, iovcnt, &f->off);
+    releasesleep(&f->offlock);
+    return r;
+  }
+
+  tot = 0;
+  for(i = 0; i < iovcnt; i++){
+    if((r = filewrite(f, (uint64)iov[i].iov_base, iov[i].iov_len)) < 0)
+      return -1;
+    tot += r;
+  }
+  return tot;
+}
+
 // Read from file f.
 // addr is a user virtual address.
 int
 fileread(struct file *f, uint64 addr, int n)
 {
+  struct iovec iov;
   int r = 0;
 
   if(f->readable == 0)
@@ -118,10 +249,9 @@ fileread(struct file *f, uint64 addr, int n)
       return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
+    iov.iov_base = (void*)addr;
+    iov.iov_len = n;
+    r = filereadv(f, &iov, 1);
   } else {
     panic("fileread");
   }
@@ -134,7 +264,8 @@ fileread(struct file *f, uint64 addr, int n)
 int
 filewrite(struct file *f, uint64 addr, int n)
 {
-  int r, ret = 0;
+  struct iovec iov;
+  int ret = 0;
 
   if(f->writable == 0)
     return -1;
@@ -146,33 +277,9 @@ filewrite(struct file *f, uint64 addr, int n)
       return -1;
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
-
-      if(r < 0)
-        break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
-    }
-    ret = (i == n ? n : -1);
+    iov.iov_base = (void*)addr;
+    iov.iov_len = n;
+    ret = filewritev(f, &iov, 1);
   } else {
     panic("filewrite");
   }
@@ -180,3 +287,30 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+// Read from file f at offset off, leaving f->off alone.
+// Only for files with an inode.
+int
+filepread(struct file *f, uint64 addr, int n, uint off)
+{
+  struct iovec iov;
+
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return inoderead(f->ip, &iov, 1, &off);
+}
+
+// Write to file f at offset off, leaving f->off alone.
+// Only for files with an inode.
+int
+filepwrite(struct file *f, uint64 addr, int n, uint off)
+{
+  struct iovec iov;
+
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return inodewrite(f->ip, &iov, 1, &off);
+}
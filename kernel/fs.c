@@ -20,6 +20,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "slab.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 // there should be one superblock per disk device, but we run with
@@ -44,6 +45,7 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  swapinit(dev, &sb);
 }
 
 // Zero a block.
@@ -162,29 +164,35 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// In-memory inodes are allocated from a slab cache when
+// iget() first references them and freed when iput() drops
+// the last reference, so the number of active inodes is
+// limited only by memory. Active inodes are kept in a hash
+// table on (dev, inum) so that iget() can find them quickly.
+//
+// The icache.lock spin-lock protects the hash table and the
+// allocation of icache entries. Since ip->ref indicates whether
+// an entry is in use, and ip->dev and ip->inum indicate which
+// i-node an entry holds, one must hold icache.lock while using
+// any of those fields.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
+// next, dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct slabcache cache;
+  struct inode *hash[NINODE];
 } icache;
 
+#define IHASH(dev, inum) (((dev) * 31 + (inum)) % NINODE)
+
 void
 iinit()
 {
-  int i = 0;
-  
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
-  }
+  initslab(&icache.cache, "inode", sizeof(struct inode));
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -242,31 +250,31 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **bucket;
 
   acquire(&icache.lock);
 
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+  bucket = &icache.hash[IHASH(dev, inum)];
+  for(ip = *bucket; ip; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
       ip->ref++;
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
+  // Allocate a new inode cache entry.
+  if((ip = slaballoc(&icache.cache)) == 0)
     panic("iget: no inodes");
 
-  ip = empty;
+  initsleeplock(&ip->lock, "inode");
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->next = *bucket;
+  *bucket = ip;
   release(&icache.lock);
 
   return ip;
@@ -322,9 +330,39 @@ iunlock(struct inode *ip)
   releasesleep(&ip->lock);
 }
 
+// Lock the given inode shared with other readers,
+// for paths that only read it or its contents.
+// Reads the inode from disk if necessary.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  acquiresleepshared(&ip->lock);
+
+  if(ip->valid == 0){
+    // Filling in the inode needs the lock exclusively.
+    // Our reference keeps it valid once it is.
+    releasesleepshared(&ip->lock);
+    ilock(ip);
+    iunlock(ip);
+    acquiresleepshared(&ip->lock);
+  }
+}
+
+void
+iunlockshared(struct inode *ip)
+{
+  if(ip == 0 || !holdingsleepshared(&ip->lock) || ip->ref < 1)
+    panic("iunlockshared");
+
+  releasesleepshared(&ip->lock);
+}
+
 // Drop a reference to an in-memory inode.
-// If that was the last reference, the inode cache entry can
-// be recycled.
+// If that was the last reference, the inode cache entry is
+// freed.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -354,6 +392,15 @@ iput(struct inode *ip)
   }
 
   ip->ref--;
+  if(ip->ref == 0){
+    struct inode **pp = &icache.hash[IHASH(ip->dev, ip->inum)];
+    while(*pp != ip)
+      pp = &(*pp)->next;
+    *pp = ip->next;
+    release(&icache.lock);
+    slabfree(&icache.cache, ip);
+    return;
+  }
   release(&icache.lock);
 }
 
@@ -365,6 +412,13 @@ iunlockput(struct inode *ip)
   iput(ip);
 }
 
+void
+iunlockputshared(struct inode *ip)
+{
+  iunlockshared(ip);
+  iput(ip);
+}
+
 // Inode content
 //
 // The content (data) associated with each inode is stored
@@ -437,7 +491,7 @@ itrunc(struct inode *ip)
 }
 
 // Copy stat information from inode.
-// Caller must hold ip->lock.
+// Caller must hold ip->lock, perhaps shared.
 void
 stati(struct inode *ip, struct stat *st)
 {
@@ -449,7 +503,7 @@ stati(struct inode *ip, struct stat *st)
 }
 
 // Read data from inode.
-// Caller must hold ip->lock.
+// Caller must hold ip->lock, perhaps shared.
 // If user_dst==1, then dst is a user virtual address;
 // otherwise, dst is a kernel address.
 int
@@ -464,13 +518,13 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    bp = breadshared(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
-      brelse(bp);
+      brelseshared(bp);
       break;
     }
-    brelse(bp);
+    brelseshared(bp);
   }
   return tot;
 }
@@ -633,21 +687,21 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    ilockshared(ip);
     if(ip->type != T_DIR){
-      iunlockput(ip);
+      iunlockputshared(ip);
       return 0;
     }
     if(nameiparent && *path == '\0'){
       // Stop one level early.
-      iunlock(ip);
+      iunlockshared(ip);
       return ip;
     }
     if((next = dirlookup(ip, name, 0)) == 0){
-      iunlockput(ip);
+      iunlockputshared(ip);
       return 0;
     }
-    iunlockput(ip);
+    iunlockputshared(ip);
     ip = next;
   }
   if(nameiparent){
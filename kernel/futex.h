@@ -0,0 +1,3 @@
+// Operations of the futex() system call.
+#define FUTEX_WAIT 0  // sleep if the int at addr is still val
+#define FUTEX_WAKE 1  // wake up to val processes sleeping on addr
@@ -0,0 +1,158 @@
+// Disk request scheduling, between the buffer cache and
+// the virtio disk driver.
+//
+// iosubmit() queues a buffer for reading or writing, sorted
+// by block number; iowait() starts the queued requests and
+// waits for one buffer to finish. A caller with several
+// buffers to transfer submits them all before waiting, so
+// that they are in the queue together.
+//
+// Requests go to the disk in elevator order: upward from the
+// block after the last one started, then around again from
+// the lowest. Queued requests for consecutive blocks in the
+// same direction are merged into one multi-segment virtio
+// request, of up to MAXSEG blocks.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "kstat.h"
+
+struct {
+  struct spinlock lock;
+  struct buf *queue;     // waiting to be started, by block number
+  uint head;             // block after the last one started
+  int nqueued;
+  struct diskstat stat;
+} iosched;
+
+void
+ioschedinit(void)
+{
+  initlock(&iosched.lock, "iosched");
+}
+
+// Start as many queued requests as the disk will take.
+// Caller holds iosched.lock.
+static void
+dispatch(void)
+{
+  struct buf *run[MAXSEG];
+  struct buf *b, *prev, *startprev;
+  int n;
+
+  while(iosched.queue){
+    // the first request at or above head, else the lowest.
+    startprev = 0;
+    for(prev = 0, b = iosched.queue; b; prev = b, b = b->qnext){
+      if(b->blockno >= iosched.head){
+        startprev = prev;
+        break;
+      }
+    }
+    if(b == 0)
+      b = iosched.queue;
+
+    // the run of consecutive blocks that follows it.
+    n = 0;
+    run[n++] = b;
+    for(b = b->qnext; b && n < MAXSEG; b = b->qnext){
+      if(b->dev != run[n-1]->dev || b->blockno != run[n-1]->blockno + 1 ||
+         b->qwrite != run[0]->qwrite)
+        break;
+      run[n++] = b;
+    }
+
+    if(virtio_disk_start(run, n, run[0]->qwrite) < 0)
+      break;  // disk is full; iodone() will call again.
+
+    if(startprev)
+      startprev->qnext = b;
+    else
+      iosched.queue = b;
+    iosched.head = run[n-1]->blockno + 1;
+    iosched.nqueued -= n;
+    iosched.stat.nreq++;
+    iosched.stat.nblock += n;
+    if(n > 1)
+      iosched.stat.nmerged += n - 1;
+  }
+}
+
+// Queue b to be read from disk, or written if write is set.
+// The caller must hold b's sleeplock, or own b outright,
+// until iowait(b) returns.
+void
+iosubmit(struct buf *b, int write)
+{
+  struct buf **pp;
+
+  acquire(&iosched.lock);
+  if(b->disk)
+    panic("iosubmit");
+  b->disk = 1;
+  b->qwrite = write;
+  // after any queued request for the same block, so that
+  // requests for one block happen in the order submitted.
+  for(pp = &iosched.queue; *pp; pp = &(*pp)->qnext){
+    if((*pp)->dev > b->dev || ((*pp)->dev == b->dev && (*pp)->blockno > b->blockno))
+      break;
+  }
+  b->qnext = *pp;
+  *pp = b;
+  if(++iosched.nqueued > iosched.stat.maxqueue)
+    iosched.stat.maxqueue = iosched.nqueued;
+  release(&iosched.lock);
+}
+
+// Start queued requests, and wait for b's to finish.
+void
+iowait(struct buf *b)
+{
+  acquire(&iosched.lock);
+  dispatch();
+  while(b->disk)
+    sleep(b, &iosched.lock);
+  release(&iosched.lock);
+}
+
+// Read or write b and wait for it.
+void
+iorw(struct buf *b, int write)
+{
+  iosubmit(b, write);
+  iowait(b);
+}
+
+// Called by virtio_disk_intr() when the disk has
+// finished a request for the n buffers in b[].
+void
+iodone(struct buf **b, int n)
+{
+  int i;
+
+  acquire(&iosched.lock);
+  for(i = 0; i < n; i++){
+    b[i]->disk = 0;
+    wakeup(b[i]);
+  }
+  dispatch();
+  release(&iosched.lock);
+}
+
+// Fill in disk statistics. If ds is 0, reset them instead.
+void
+iostat(struct diskstat *ds)
+{
+  acquire(&iosched.lock);
+  if(ds == 0)
+    memset(&iosched.stat, 0, sizeof(iosched.stat));
+  else
+    *ds = iosched.stat;
+  release(&iosched.lock);
+}
@@ -1,12 +1,30 @@
 // Physical memory allocator, for user processes,
-// kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// kernel stacks, page-table pages, superpages,
+// and slab caches.
+//
+// A binary buddy allocator manages memory between the end of
+// the kernel and PHYSTOP. Blocks are 2^order pages, with order
+// between 0 and MAXORDER, and a block of order k always starts
+// at a multiple of 2^k pages from KERNBASE, so it is naturally
+// aligned in physical memory. A free block is merged with its
+// buddy whenever the buddy is free too.
+//
+// kalloc() and kfree() are the single-page fast path: freed
+// pages are kept on a small cache of single pages and handed
+// straight back out, without splitting or merging blocks. The
+// cache is drained into the buddy lists when a multi-page
+// allocation would otherwise fail.
+//
+// A page can be shared, as shared memory segments are: kref()
+// counts each extra reference, and kfree() only drops one while
+// there are any.
 
 #include "types.h"
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "kstat.h"
 #include "defs.h"
 
 void freerange(void *pa_start, void *pa_end);
@@ -14,20 +32,134 @@ void freerange(void *pa_start, void *pa_end);
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
+#define NPAGE     ((PHYSTOP - KERNBASE) / PGSIZE)
+#define PA2IDX(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+#define IDX2PA(i) ((void*)(KERNBASE + (uint64)(i) * PGSIZE))
+
+#define KCACHE    64    // max single pages kept on the cache
+
+// pageinfo[] bits, meaningful only for the first page of a block.
+#define PG_FREE   0x80  // block is on a free list
+#define PG_ORDER  0x7f  // order of the block
+
 struct run {
   struct run *next;
+  struct run *prev;
 };
 
 struct {
   struct spinlock lock;
-  struct run *freelist;
+  struct run free[MAXORDER+1];  // circular lists of free blocks, per order
+  uint64 nfree[MAXORDER+1];     // blocks on each free list
+  struct run *cache;            // free single pages
+  int ncache;
+  uchar pageinfo[NPAGE];
+  uchar refs[NPAGE];            // references to each page beyond the first
+  uint64 npage;                 // pages handed to the allocator at boot
+  uint64 nalloc;
+  uint64 nfail;
+  uint64 nsplit;
+  uint64 nmerge;
 } kmem;
 
+static void
+listpush(int order, struct run *r)
+{
+  struct run *h = &kmem.free[order];
+
+  r->next = h->next;
+  r->prev = h;
+  h->next->prev = r;
+  h->next = r;
+  kmem.nfree[order]++;
+}
+
+static void
+listremove(int order, struct run *r)
+{
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+  kmem.nfree[order]--;
+}
+
+// Take a block of 2^order pages off the free lists,
+// splitting a larger block if needed.
+// Caller must hold kmem.lock.
+static void*
+buddyalloc(int order)
+{
+  struct run *r;
+  uint64 idx;
+  int k;
+
+  for(k = order; k <= MAXORDER; k++)
+    if(kmem.nfree[k])
+      break;
+  if(k > MAXORDER)
+    return 0;
+
+  r = kmem.free[k].next;
+  listremove(k, r);
+  idx = PA2IDX(r);
+  while(k > order){
+    // give the upper half back as a free block of order k-1.
+    k--;
+    kmem.pageinfo[idx + (1L << k)] = PG_FREE | k;
+    listpush(k, (struct run*)IDX2PA(idx + (1L << k)));
+    kmem.nsplit++;
+  }
+  kmem.pageinfo[idx] = order;
+  return (void*)r;
+}
+
+// Put a block of 2^order pages back on the free lists,
+// merging it with its buddy as long as the buddy is free.
+// Caller must hold kmem.lock.
+static void
+buddyfree(uint64 idx, int order)
+{
+  uint64 b;
+
+  while(order < MAXORDER){
+    b = idx ^ (1L << order);
+    if(b >= NPAGE || kmem.pageinfo[b] != (PG_FREE | order))
+      break;
+    listremove(order, (struct run*)IDX2PA(b));
+    kmem.pageinfo[b] = 0;
+    idx &= ~(1L << order);
+    order++;
+    kmem.nmerge++;
+  }
+  kmem.pageinfo[idx] = PG_FREE | order;
+  listpush(order, (struct run*)IDX2PA(idx));
+}
+
+// Move every page on the single-page cache back to the
+// buddy lists, so that it can be merged into larger blocks.
+// Caller must hold kmem.lock.
+static void
+drain(void)
+{
+  struct run *r;
+
+  while((r = kmem.cache) != 0){
+    kmem.cache = r->next;
+    buddyfree(PA2IDX(r), 0);
+  }
+  kmem.ncache = 0;
+}
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
+  for(int k = 0; k <= MAXORDER; k++)
+    kmem.free[k].next = kmem.free[k].prev = &kmem.free[k];
   freerange(end, (void*)PHYSTOP);
+  acquire(&kmem.lock);
+  drain();
+  kmem.npage = nfreepages();
+  release(&kmem.lock);
 }
 
 void
@@ -43,6 +175,8 @@ freerange(void *pa_start, void *pa_end)
 // which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// A single page of a block from kallocpages() may
+// also be freed this way.
 void
 kfree(void *pa)
 {
@@ -51,15 +185,96 @@ kfree(void *pa)
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  // drop a reference to a shared page. refs[] can be read
+  // without the lock: if the caller holds the only reference,
+  // no one else can be adding one.
+  if(kmem.refs[PA2IDX(pa)] > 0){
+    acquire(&kmem.lock);
+    if(kmem.refs[PA2IDX(pa)] > 0){
+      kmem.refs[PA2IDX(pa)]--;
+      release(&kmem.lock);
+      return;
+    }
+    release(&kmem.lock);
+  }
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
   r = (struct run*)pa;
 
   acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
+  if(kmem.pageinfo[PA2IDX(pa)] & PG_FREE)
+    panic("kfree: free page");
+  kmem.pageinfo[PA2IDX(pa)] = 0;
+  if(kmem.ncache < KCACHE){
+    r->next = kmem.cache;
+    kmem.cache = r;
+    kmem.ncache++;
+  } else
+    buddyfree(PA2IDX(pa), 0);
+  release(&kmem.lock);
+}
+
+// Add a reference to the page at pa, which the caller
+// holds a reference to; kfree() drops one.
+void
+kref(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kref");
+  acquire(&kmem.lock);
+  if(kmem.refs[PA2IDX(pa)] == 255)
+    panic("kref: too many");
+  kmem.refs[PA2IDX(pa)]++;
+  release(&kmem.lock);
+}
+
+// Take 2^order pages from the single-page cache or the buddy
+// lists, draining the cache if that lets a larger block form.
+static void*
+getpages(int order)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  if(order == 0 && (r = kmem.cache) != 0){
+    kmem.cache = r->next;
+    kmem.ncache--;
+  } else if((r = buddyalloc(order)) == 0 && kmem.ncache > 0){
+    drain();
+    r = buddyalloc(order);
+  }
+  if(r)
+    kmem.nalloc++;
   release(&kmem.lock);
+  return (void*)r;
+}
+
+// Allocate 2^order physically contiguous pages, aligned
+// to their size relative to KERNBASE.
+// Returns 0 if the memory cannot be allocated.
+// If memory is short, pages cached by the slab
+// allocator are reclaimed first.
+void *
+kallocpages(int order)
+{
+  void *pa;
+
+  if(order < 0 || order > MAXORDER)
+    panic("kallocpages");
+
+  if((pa = getpages(order)) == 0 && slabreclaim() > 0)
+    pa = getpages(order);
+  if(pa == 0){
+    acquire(&kmem.lock);
+    kmem.nfail++;
+    release(&kmem.lock);
+    return 0;
+  }
+
+  memset(pa, 5, PGSIZE << order); // fill with junk
+  return pa;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -68,15 +283,66 @@ kfree(void *pa)
 void *
 kalloc(void)
 {
-  struct run *r;
+  return kallocpages(0);
+}
+
+// Free a block of 2^order pages returned by kallocpages(order).
+void
+kfreepages(void *pa, int order)
+{
+  uint64 idx;
+
+  if(order < 0 || order > MAXORDER)
+    panic("kfreepages");
+  if(order == 0){
+    kfree(pa);
+    return;
+  }
+  idx = PA2IDX(pa);
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end ||
+     (uint64)pa + (PGSIZE << order) > PHYSTOP || (idx & ((1L << order) - 1)) != 0)
+    panic("kfreepages");
+
+  memset(pa, 1, PGSIZE << order);
 
   acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
+  if(kmem.pageinfo[idx] & PG_FREE)
+    panic("kfreepages: free block");
+  buddyfree(idx, order);
   release(&kmem.lock);
+}
 
-  if(r)
-    memset((char*)r, 5, PGSIZE); // fill with junk
-  return (void*)r;
+// Number of free pages, including the single-page cache.
+// Caller must hold kmem.lock, or accept a racy answer.
+uint64
+nfreepages(void)
+{
+  uint64 n = kmem.ncache;
+
+  for(int k = 0; k <= MAXORDER; k++)
+    n += kmem.nfree[k] << k;
+  return n;
+}
+
+// Fill in allocator statistics. If ms is 0, reset the
+// event counters instead.
+void
+kallocstat(struct memstat *ms)
+{
+  acquire(&kmem.lock);
+  if(ms == 0){
+    kmem.nalloc = kmem.nfail = kmem.nsplit = kmem.nmerge = 0;
+    release(&kmem.lock);
+    return;
+  }
+  ms->npage = kmem.npage;
+  ms->nfree = nfreepages();
+  ms->ncached = kmem.ncache;
+  for(int k = 0; k <= MAXORDER; k++)
+    ms->nblock[k] = kmem.nfree[k];
+  ms->nalloc = kmem.nalloc;
+  ms->nfail = kmem.nfail;
+  ms->nsplit = kmem.nsplit;
+  ms->nmerge = kmem.nmerge;
+  release(&kmem.lock);
 }
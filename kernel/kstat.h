@@ -0,0 +1,52 @@
+// Kernel statistics returned by the kstat() system call.
+// Include param.h first.
+
+#define KSTAT_MEM  1   // physical memory allocator: struct memstat
+#define KSTAT_SWAP 2   // swapping: struct swapstat
+#define KSTAT_LOCK 3   // spinlocks: struct lockstat per lock name
+#define KSTAT_LOG  4   // file system log: struct logstat
+#define KSTAT_DISK 5   // disk requests: struct diskstat
+
+struct memstat {
+  uint64 npage;               // pages managed by the allocator
+  uint64 nfree;               // free pages, including cached single pages
+  uint64 ncached;             // free pages on the single-page cache
+  uint64 nblock[MAXORDER+1];  // free blocks of 2^k pages
+  uint64 nalloc;              // successful allocations
+  uint64 nfail;               // failed allocations
+  uint64 nsplit;              // blocks split in two
+  uint64 nmerge;              // buddies merged
+};
+
+struct swapstat {
+  uint64 nslot;               // page slots in the swap area
+  uint64 nused;               // slots holding swapped-out pages
+  uint64 nout;                // pages swapped out
+  uint64 nin;                 // pages swapped in
+};
+
+struct lockstat {
+  char name[16];              // name of the locks counted
+  uint64 nacquire;            // acquire() calls
+  uint64 ncontended;          // acquire() calls that had to spin
+  uint64 nspin;               // spin loop iterations
+};
+
+struct logstat {
+  uint64 size;                // data blocks the log can hold
+  uint64 nop;                 // begin_op() calls
+  uint64 nwait;               // begin_op() calls that waited for space
+  uint64 nlogged;             // distinct blocks logged
+  uint64 nabsorbed;           // log_write() calls absorbed by a logged block
+  uint64 ncommit;             // commits that wrote blocks
+  uint64 maxcommit;           // most blocks in one commit
+  uint64 committicks;         // ticks spent in those commits
+  uint64 nflushwait;          // commits that waited for the flusher
+};
+
+struct diskstat {
+  uint64 nreq;                // requests sent to the disk
+  uint64 nblock;              // blocks they transferred
+  uint64 nmerged;             // blocks merged into another's request
+  uint64 maxqueue;            // most requests waiting at once
+};
@@ -6,6 +6,8 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "proc.h"
+#include "kstat.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -20,36 +22,94 @@
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
 // sleeps until the last outstanding end_op() commits.
+// begin_op() reserves room for MAXOPBLOCKS blocks; an op
+// that may write more, such as a large write(), reserves
+// what it needs with begin_opn().
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
 //   header block, containing block #s for block A, B, C, ...
+//     and a checksum
 //   block A
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// A commit writes the header and the blocks to the log together.
+//
+// The header's checksum covers its sequence number, the block
+// numbers, and the logged blocks' contents. Writing the header
+// commits the transaction, but the header is not cleared after
+// the blocks are installed: recovery installs the transaction
+// in the header only if the checksum matches what is in the
+// log, and the next transaction's log writes spoil the match.
+// Installing the most recent committed transaction a second
+// time is harmless.
+//
+// Once a transaction commits, the flusher kernel thread writes
+// its blocks home in the background, in block order, while the
+// next transaction goes on in memory. Until a block is home it
+// stays pinned in the buffer cache, so that reads see it. The
+// flusher writes the copy in the log, not the cached block,
+// which the next transaction may already have changed. The next
+// commit overwrites the log, so it waits for the flusher.
+//
+// mkfs chooses the size of the log and records it in the
+// superblock; the kernel uses up to LOGSIZE blocks of it.
+
+#define LOGHASH 64   // buckets for finding a block in the log
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
   int n;
+  uint seq;       // transaction sequence number
+  uint cksum;     // over seq, n, block[], and the logged blocks
   int block[LOGSIZE];
 };
 
 struct log {
   struct spinlock lock;
   int start;
-  int size;
+  int size;        // data blocks the log can hold
   int outstanding; // how many FS sys calls are executing.
+  int reserved;    // blocks reserved by them
   int committing;  // in commit(), please wait.
   int dev;
+  uint seq;        // of the last committed transaction
   struct logheader lh;
+
+  // lh.block[] indices, hashed by block number, so that
+  // log_write() finds an absorbed block without a scan.
+  int hash[LOGHASH];       // first index in each bucket, or -1
+  int hnext[LOGSIZE];      // next index in the same bucket
+
+  // the last commit, which the flusher is writing home.
+  int installing;          // flusher has not finished
+  int ninstall;
+  struct {
+    int home;              // block number
+    int tail;              // position in the log
+    struct buf *b;         // cached block, pinned until home
+  } inst[LOGSIZE];
+  struct buf fbuf[MAXSEG]; // for the flusher's writes
+
+  struct logstat stat;     // counters, protected by lock
 };
 struct log log;
 
 static void recover_from_log(void);
 static void commit();
+static void flusher(void);
+
+// Empty the hash table, once the log is empty.
+static void
+clearhash(void)
+{
+  int i;
+
+  for(i = 0; i < LOGHASH; i++)
+    log.hash[i] = -1;
+}
 
 void
 initlog(int dev, struct superblock *sb)
@@ -59,12 +119,46 @@ initlog(int dev, struct superblock *sb)
 
   initlock(&log.lock, "log");
   log.start = sb->logstart;
-  log.size = sb->nlog;
+  log.size = sb->nlog - 1;  // less the header block
+  if(log.size > LOGSIZE)
+    log.size = LOGSIZE;
+  if(log.size < MAXOPBLOCKS)
+    panic("initlog: log too small");
   log.dev = dev;
+  log.stat.size = log.size;
+  clearhash();
   recover_from_log();
+  kthreadcreate(flusher, "flusher");
 }
 
-// Copy committed blocks from log to their home location
+#define FNVBASIS 2166136261
+#define FNVPRIME 16777619
+
+// Add n bytes at data, a multiple of 4, to checksum h.
+static uint
+cksum(uint h, void *data, int n)
+{
+  uint *w = data;
+  int i;
+
+  for(i = 0; i < n/4; i++)
+    h = (h ^ w[i]) * FNVPRIME;
+  return h;
+}
+
+// Start the checksum of a transaction from its header.
+static uint
+headsum(struct logheader *lh)
+{
+  uint h = FNVBASIS;
+
+  h = cksum(h, &lh->seq, sizeof(lh->seq));
+  h = cksum(h, &lh->n, sizeof(lh->n));
+  return cksum(h, lh->block, lh->n * sizeof(lh->block[0]));
+}
+
+// Copy committed blocks from log to their home location.
+// Used by recovery; otherwise the flusher does this.
 static void
 install_trans(void)
 {
@@ -75,7 +169,6 @@ install_trans(void)
     struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
     memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
     bwrite(dbuf);  // write dst to disk
-    bunpin(dbuf);
     brelse(lbuf);
     brelse(dbuf);
   }
@@ -89,57 +182,85 @@ read_head(void)
   struct logheader *lh = (struct logheader *) (buf->data);
   int i;
   log.lh.n = lh->n;
+  log.lh.seq = lh->seq;
+  log.lh.cksum = lh->cksum;
+  if (log.lh.n < 0 || log.lh.n > log.size)
+    log.lh.n = 0;  // not a header we wrote
   for (i = 0; i < log.lh.n; i++) {
     log.lh.block[i] = lh->block[i];
   }
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
-static void
-write_head(void)
+// Does the checksum in the header match the log?
+// If not, the log was being overwritten by a later
+// transaction that did not commit.
+static int
+valid_log(void)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *) (buf->data);
-  int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  uint h;
+  int tail;
+
+  h = headsum(&log.lh);
+  for (tail = 0; tail < log.lh.n; tail++) {
+    struct buf *lbuf = bread(log.dev, log.start+tail+1);
+    h = cksum(h, lbuf->data, BSIZE);
+    brelse(lbuf);
   }
-  bwrite(buf);
-  brelse(buf);
+  return h == log.lh.cksum;
 }
 
 static void
 recover_from_log(void)
 {
   read_head();
-  install_trans(); // if committed, copy from log to disk
+  if(log.lh.n > 0 && valid_log())
+    install_trans(); // if committed, copy from log to disk
+  log.seq = log.lh.seq;
   log.lh.n = 0;
-  write_head(); // clear the log
 }
 
-// called at the start of each FS system call.
+// The number of blocks an op may reserve: the log's size.
+int
+logsize(void)
+{
+  return log.size;
+}
+
+// called at the start of an FS system call that
+// will write at most n blocks.
 void
-begin_op(void)
+begin_opn(int n)
 {
+  if(n > log.size)
+    panic("begin_opn");
+
   acquire(&log.lock);
+  log.stat.nop++;
   while(1){
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(log.lh.n + log.reserved + n > log.size){
       // this op might exhaust log space; wait for commit.
+      log.stat.nwait++;
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.reserved += n;
+      myproc()->logres = n;
       release(&log.lock);
       break;
     }
   }
 }
 
+// called at the start of each FS system call.
+void
+begin_op(void)
+{
+  begin_opn(MAXOPBLOCKS);
+}
+
 // called at the end of each FS system call.
 // commits if this was the last outstanding operation.
 void
@@ -149,6 +270,8 @@ end_op(void)
 
   acquire(&log.lock);
   log.outstanding -= 1;
+  log.reserved -= myproc()->logres;
+  myproc()->logres = 0;
   if(log.committing)
     panic("log.committing");
   if(log.outstanding == 0){
@@ -173,31 +296,163 @@ end_op(void)
   }
 }
 
-// Copy modified blocks from cache to log.
+// Wait until every op that has called end_op() is on disk.
+// An op's blocks commit with the last op of its transaction,
+// so this waits for the others in the current one to finish.
+void
+log_force(void)
+{
+  uint want;
+
+  acquire(&log.lock);
+  while(log.committing)
+    sleep(&log, &log.lock);
+  if(log.lh.n > 0){
+    // end_op() commits once the outstanding ops are done.
+    want = log.seq + 1;
+    while(log.seq < want)
+      sleep(&log, &log.lock);
+  }
+  release(&log.lock);
+}
+
+// Write the header and the modified blocks to the log.
+// Writing the header is the true point at which the current
+// transaction commits, but since recovery checks the header's
+// checksum against the blocks, they can go to the disk together,
+// MAXSEG at a time, in any order. Notes the blocks for the
+// flusher.
 static void
 write_log(void)
 {
-  int tail;
+  struct buf *b[MAXSEG];
+  struct logheader *hb;
+  uint h;
+  int tail, i, nb;
 
+  h = headsum(&log.lh);
   for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
+    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
+    h = cksum(h, from->data, BSIZE);
+    log.inst[tail].home = from->blockno;
+    log.inst[tail].tail = tail;
+    log.inst[tail].b = from;
+    brelse(from);
+  }
+  log.lh.cksum = h;
+
+  b[0] = bblank(log.dev, log.start);
+  hb = (struct logheader *) (b[0]->data);
+  memset(b[0]->data, 0, BSIZE);
+  hb->n = log.lh.n;
+  hb->seq = log.lh.seq;
+  hb->cksum = log.lh.cksum;
+  for (i = 0; i < log.lh.n; i++) {
+    hb->block[i] = log.lh.block[i];
+  }
+  nb = 1;
+
+  for (tail = 0; tail < log.lh.n; tail++) {
+    struct buf *to = bblank(log.dev, log.start+tail+1); // log block
     struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
     memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
     brelse(from);
-    brelse(to);
+    b[nb++] = to;
+    if (nb == MAXSEG || tail == log.lh.n - 1) {
+      bwritev(b, nb);  // write the log
+      for (i = 0; i < nb; i++)
+        brelse(b[i]);
+      nb = 0;
+    }
+  }
+}
+
+// Write the last committed transaction's blocks home,
+// from the copies in the log, in block order.
+static void
+flusher(void)
+{
+  struct buf *lbuf;
+  int i, j, n, home, tail;
+  struct buf *b;
+
+  for(;;){
+    acquire(&log.lock);
+    while(!log.installing)
+      sleep(&log.ninstall, &log.lock);
+    release(&log.lock);
+
+    for(i = 1; i < log.ninstall; i++){
+      home = log.inst[i].home;
+      tail = log.inst[i].tail;
+      b = log.inst[i].b;
+      for(j = i; j > 0 && log.inst[j-1].home > home; j--)
+        log.inst[j] = log.inst[j-1];
+      log.inst[j].home = home;
+      log.inst[j].tail = tail;
+      log.inst[j].b = b;
+    }
+
+    for(i = 0; i < log.ninstall; i += n){
+      n = log.ninstall - i;
+      if(n > MAXSEG)
+        n = MAXSEG;
+      for(j = 0; j < n; j++){
+        lbuf = bread(log.dev, log.start+log.inst[i+j].tail+1);
+        memmove(log.fbuf[j].data, lbuf->data, BSIZE);
+        brelse(lbuf);
+        log.fbuf[j].dev = log.dev;
+        log.fbuf[j].blockno = log.inst[i+j].home;
+        iosubmit(&log.fbuf[j], 1);
+      }
+      for(j = 0; j < n; j++){
+        iowait(&log.fbuf[j]);
+        bunpin(log.inst[i+j].b);
+      }
+    }
+
+    acquire(&log.lock);
+    log.installing = 0;
+    wakeup(&log.installing);
+    release(&log.lock);
   }
 }
 
 static void
 commit()
 {
+  uint t0;
+  int n;
+
   if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
+    t0 = ticks;
+    n = log.lh.n;
+
+    // the log still holds the last commit until
+    // the flusher has written it home.
+    acquire(&log.lock);
+    if(log.installing)
+      log.stat.nflushwait++;
+    while(log.installing)
+      sleep(&log.installing, &log.lock);
+    release(&log.lock);
+
+    log.lh.seq = log.seq + 1;
+    write_log();     // Write header and modified blocks to log -- the real commit
+    log.seq = log.lh.seq;
     log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+    clearhash();
+
+    // have the flusher install the writes to home locations.
+    acquire(&log.lock);
+    log.ninstall = n;
+    log.installing = 1;
+    wakeup(&log.ninstall);
+    log.stat.ncommit++;
+    log.stat.committicks += ticks - t0;
+    if(n > log.stat.maxcommit)
+      log.stat.maxcommit = n;
+    release(&log.lock);
   }
 }
 
@@ -213,23 +468,42 @@ commit()
 void
 log_write(struct buf *b)
 {
-  int i;
+  int i, h;
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= log.size)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
 
   acquire(&log.lock);
-  for (i = 0; i < log.lh.n; i++) {
+  h = b->blockno % LOGHASH;
+  for (i = log.hash[h]; i >= 0; i = log.hnext[i]) {
     if (log.lh.block[i] == b->blockno)   // log absorbtion
       break;
   }
-  log.lh.block[i] = b->blockno;
-  if (i == log.lh.n) {  // Add new block to log?
+  if (i < 0) {  // Add new block to log
+    i = log.lh.n++;
+    log.lh.block[i] = b->blockno;
+    log.hnext[i] = log.hash[h];
+    log.hash[h] = i;
     bpin(b);
-    log.lh.n++;
-  }
+    log.stat.nlogged++;
+  } else
+    log.stat.nabsorbed++;
+  release(&log.lock);
+}
+
+// Copy the log statistics to ls. If ls is 0,
+// reset the counters instead.
+void
+logstat(struct logstat *ls)
+{
+  acquire(&log.lock);
+  if(ls == 0){
+    memset(&log.stat, 0, sizeof(log.stat));
+    log.stat.size = log.size;
+  } else
+    *ls = log.stat;
   release(&log.lock);
 }
 
@@ -27,6 +27,9 @@ main()
     binit();         // buffer cache
     iinit();         // inode cache
     fileinit();      // file table
+    pipeinit();      // pipe cache
+    shminit();       // shared memory segments
+    ioschedinit();   // disk request queue
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
@@ -62,6 +62,25 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   USHM .. USHMEND (shared memory segments, see shm.c)
+//   ...
+//   UTRAPFRAME(NTHREAD-1) .. UTRAPFRAME(0) (clone() threads' trapframes)
+//   URING (p->ring, if the process called ringsetup())
+//   USYSCALL (p->usyscall, read-only to the process)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define USYSCALL (TRAPFRAME - PGSIZE)
+#define URING (USYSCALL - PGSIZE)
+#define UTRAPFRAME(i) (URING - ((i)+1)*PGSIZE)
+#define USHM (MAXVA / 4)
+#define USHMEND (MAXVA / 2)
+
+// The kernel fills in the USYSCALL page each time it returns
+// to user space, so that user code can get these values without
+// a system call. See ugetpid() etc. in user/ulib.c.
+struct usyscall {
+  int pid;     // process ID
+  uint ticks;  // as returned by uptime()
+  uint64 time; // the time CSR (CLINT mtime)
+};
@@ -1,13 +1,25 @@
 #define NPROC        64  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // buckets in the i-node cache hash table
 #define NDEV         10  // maximum major device number
+#define TICKETLOCK    1  // 1 -> FIFO ticket spinlocks, 0 -> test-and-set
+#define NLOCKCLASS   64  // lock names tracked by lock statistics
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define MAXIOV       16  // max buffers per readv/writev
+#define MAXSPAWNACT   8  // max file descriptor actions per spawn
+#define NTHREAD      16  // max threads clone() adds to one address space
+#define NSHM         16  // shared memory segments in the system
+#define NSHMATT       4  // segments one process can attach
+#define SHMPAGES     64  // max pages in a segment
+#define SHMNAME      16  // max length of a segment name, with its nul
+#define PIPEBUF     128  // pipe writes up to this size are atomic
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define LOGSIZE     128  // max data blocks in on-disk log
+#define NBUF         (2*LOGSIZE+MAXOPBLOCKS*3)  // size of disk block cache
+#define FSSIZE       2000  // size of file system in blocks
+#define MAXSEG       16  // most blocks in one disk request
+#define SWAPSIZE     65536 // size of swap area after the file system, in blocks
 #define MAXPATH      128   // maximum file path name
+#define MAXORDER     10    // largest kallocpages() block is 2^MAXORDER pages
@@ -7,8 +7,11 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "slab.h"
+#include "uio.h"
 
 #define PIPESIZE 512
+#define PIPECHUNK PIPEBUF  // bytes copied to or from user space at a time
 
 struct pipe {
   struct spinlock lock;
@@ -19,6 +22,16 @@ struct pipe {
   int writeopen;  // write fd is still open
 };
 
+// pipes are much smaller than a page, so they come from
+// a slab cache rather than straight from kalloc().
+struct slabcache pipecache;
+
+void
+pipeinit(void)
+{
+  initslab(&pipecache, "pipe", sizeof(struct pipe));
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,7 +41,7 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == 0)
+  if((pi = (struct pipe*)slaballoc(&pipecache)) == 0)
     goto bad;
   pi->readopen = 1;
   pi->writeopen = 1;
@@ -47,7 +60,7 @@ pipealloc(struct file **f0, struct file **f1)
 
  bad:
   if(pi)
-    kfree((char*)pi);
+    slabfree(&pipecache, pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -68,21 +81,32 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    slabfree(&pipecache, pi);
   } else
     release(&pi->lock);
 }
 
+// copyin() and copyout() may sleep to swap a user page in,
+// so pipewrite() and piperead() copy through a small buffer
+// on the kernel stack and never call them holding pi->lock.
+
 int
 pipewrite(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
-  char ch;
+  int i, k, m;
+  char buf[PIPECHUNK];
   struct proc *pr = myproc();
 
-  acquire(&pi->lock);
-  for(i = 0; i < n; i++){
-    while(pi->nwrite == pi->nread + PIPESIZE){  //DOC: pipewrite-full
+  for(i = 0; i < n; i += m){
+    m = n - i;
+    if(m > PIPECHUNK)
+      m = PIPECHUNK;
+    if(copyin(pr->pagetable, buf, addr + i, m) == -1)
+      break;
+    acquire(&pi->lock);
+    // a write of at most PIPEBUF bytes waits for room for
+    // all of it, so it is never interleaved with other writes.
+    while(n <= PIPEBUF && pi->nwrite + m > pi->nread + PIPESIZE){
       if(pi->readopen == 0 || pr->killed){
         release(&pi->lock);
         return -1;
@@ -90,21 +114,43 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       wakeup(&pi->nread);
       sleep(&pi->nwrite, &pi->lock);
     }
-    if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-      break;
-    pi->data[pi->nwrite++ % PIPESIZE] = ch;
+    for(k = 0; k < m; k++){
+      while(pi->nwrite == pi->nread + PIPESIZE){  //DOC: pipewrite-full
+        if(pi->readopen == 0 || pr->killed){
+          release(&pi->lock);
+          return -1;
+        }
+        wakeup(&pi->nread);
+        sleep(&pi->nwrite, &pi->lock);
+      }
+      pi->data[pi->nwrite++ % PIPESIZE] = buf[k];
+    }
+    wakeup(&pi->nread);
+    release(&pi->lock);
   }
-  wakeup(&pi->nread);
-  release(&pi->lock);
   return i;
 }
 
 int
 piperead(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
+  struct iovec iov;
+
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n > 0 ? n : 0;
+  return pipereadv(pi, &iov, 1);
+}
+
+// Read into the iovcnt user buffers in iov. Waits only until
+// the pipe has data: whatever is there is spread across the
+// buffers, and the call returns rather than wait for more.
+int
+pipereadv(struct pipe *pi, struct iovec *iov, int iovcnt)
+{
+  int i, j, m, tot;
+  uint64 addr;
+  char buf[PIPECHUNK];
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
@@ -114,14 +160,23 @@ piperead(struct pipe *pi, uint64 addr, int n)
     }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
-      break;
+  tot = 0;
+  for(j = 0; j < iovcnt; j++){
+    addr = (uint64)iov[j].iov_base;
+    for(i = 0; i < iov[j].iov_len; i += m){  //DOC: piperead-copy
+      for(m = 0; m < PIPECHUNK && i + m < iov[j].iov_len && pi->nread != pi->nwrite; m++)
+        buf[m] = pi->data[pi->nread++ % PIPESIZE];
+      if(m == 0)
+        goto done;
+      wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+      release(&pi->lock);
+      if(copyout(pr->pagetable, addr + i, buf, m) == -1)
+        return tot;
+      tot += m;
+      acquire(&pi->lock);
+    }
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+ done:
   release(&pi->lock);
-  return i;
+  return tot;
 }
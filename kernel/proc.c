@@ -3,7 +3,10 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
+#include "spawn.h"
+#include "slab.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
@@ -12,12 +15,33 @@ struct proc proc[NPROC];
 
 struct proc *initproc;
 
+// An address space shared by a process and the threads made
+// from it by clone(). All its members have the same page table,
+// which the last of them to be freed frees.
+struct uspace {
+  struct sleeplock lock;        // serializes changes to the page table
+  int ref;                      // members; uspacelock protects ref and slots
+  uint slots;                   // bit i set if UTRAPFRAME(i) is in use
+  struct trapframe *trapframe;  // page at TRAPFRAME, if its owner left first
+};
+
+struct spinlock uspacelock;
+struct slabcache uspacecache;
+
+// held while checking a futex's value before sleeping on it,
+// and while waking its sleepers, so no wakeup is lost.
+struct spinlock futexlock;
+
+#define SLOT(va) ((URING - (va)) / PGSIZE - 1)  // inverse of UTRAPFRAME
+
 int nextpid = 1;
 struct spinlock pid_lock;
 
 extern void forkret(void);
+static void kthreadret(void);
 static void wakeup1(struct proc *chan);
 static void freeproc(struct proc *p);
+static int waitfor(int tid, uint64 addr);
 
 extern char trampoline[]; // trampoline.S
 
@@ -28,6 +52,9 @@ procinit(void)
   struct proc *p;
   
   initlock(&pid_lock, "nextpid");
+  initlock(&uspacelock, "uspace");
+  initlock(&futexlock, "futex");
+  initslab(&uspacecache, "uspace", sizeof(struct uspace));
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
 
@@ -106,12 +133,24 @@ allocproc(void)
 
 found:
   p->pid = allocpid();
+  p->state = USED;
+  p->trapva = TRAPFRAME;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+
+  // Allocate the page for system calls that need no trap.
+  if((p->usyscall = (struct usyscall *)kalloc()) == 0){
+    freeproc(p);
     release(&p->lock);
     return 0;
   }
+  memset(p->usyscall, 0, PGSIZE);
+  p->usyscall->pid = p->pid;
 
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
@@ -136,12 +175,18 @@ found:
 static void
 freeproc(struct proc *p)
 {
+  if(p->uspace && !uspaceleave(p, p->pagetable))
+    p->pagetable = 0;  // the other threads still use it
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
+  if(p->usyscall)
+    kfree((void*)p->usyscall);
+  p->usyscall = 0;
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
+  p->ring = 0;
   p->sz = 0;
   p->pid = 0;
   p->parent = 0;
@@ -149,6 +194,10 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->kpreempted = 0;
+  p->vforkwait = 0;
+  p->vforkparent = 0;
+  p->kfn = 0;
   p->state = UNUSED;
 }
 
@@ -182,16 +231,32 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // map the usyscall page below the trapframe, readable
+  // but not writable by the process.
+  if(mappages(pagetable, USYSCALL, PGSIZE,
+              (uint64)(p->usyscall), PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
 // Free a process's page table, and free the
-// physical memory it refers to.
+// physical memory it refers to, including
+// any ring page.
 void
 proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
+  pte_t *pte;
+
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, USYSCALL, 1, 0);
+  if((pte = walk(pagetable, URING, 0)) != 0 && (*pte & PTE_V))
+    uvmunmap(pagetable, URING, 1, 1);
   uvmfree(pagetable, sz);
 }
 
@@ -233,24 +298,47 @@ userinit(void)
   release(&p->lock);
 }
 
-// Grow or shrink user memory by n bytes.
-// Return 0 on success, -1 on failure.
+// Grow or shrink user memory by n bytes, setting *oldsz
+// to the size before. Return 0 on success, -1 on failure.
 int
-growproc(int n)
+growproc(int n, uint64 *oldsz)
 {
   uint sz;
+  int ok;
+  struct proc *pp;
   struct proc *p = myproc();
+  struct uspace *us = p->uspace;
 
-  sz = p->sz;
-  if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+  if(us){
+    // other harts may be running threads with the freed
+    // pages in their TLBs, so a shared address space
+    // only grows.
+    if(n < 0 && uspaceshared(p))
       return -1;
-    }
+    acquiresleep(&us->lock);
+  }
+  sz = *oldsz = p->sz;
+  ok = 1;
+  if(n > 0){
+    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0)
+      ok = 0;
   } else if(n < 0){
-    sz = uvmdealloc(p->pagetable, sz, sz + n);
+    if((sz = uvmdealloc(p->pagetable, sz, sz + n)) != p->sz + n)
+      ok = 0;
   }
-  p->sz = sz;
-  return 0;
+  if(ok && us){
+    // threads made by clone() share the size too. members
+    // leave under uspacelock, so no freed slot gets sz.
+    acquire(&uspacelock);
+    for(pp = proc; pp < &proc[NPROC]; pp++)
+      if(pp->uspace == us)
+        pp->sz = sz;
+    release(&uspacelock);
+  } else if(ok)
+    p->sz = sz;
+  if(us)
+    releasesleep(&us->lock);
+  return ok ? 0 : -1;
 }
 
 // Create a new process, copying the parent.
@@ -266,13 +354,22 @@ fork(void)
   if((np = allocproc()) == 0){
     return -1;
   }
+  // np->state is USED, so nothing else will allocate or
+  // run np; drop the lock, since uvmcopy() may sleep
+  // waiting for memory.
+  release(&np->lock);
 
-  // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  // Copy user memory from parent to child, and share
+  // the parent's shared memory segments with it.
+  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0 || shmfork(p, np) < 0){
+    shmdetachall(np, np->pagetable);
+    acquire(&np->lock);
     freeproc(np);
     release(&np->lock);
     return -1;
   }
+
+  acquire(&np->lock);
   np->sz = p->sz;
 
   np->parent = p;
@@ -300,6 +397,349 @@ fork(void)
   return pid;
 }
 
+// Map p's trapframe and usyscall pages into pagetable,
+// which p may be borrowing from a vfork() parent.
+static void
+mapframe(pagetable_t pagetable, struct proc *p)
+{
+  pte_t *pte;
+
+  if((pte = walk(pagetable, TRAPFRAME, 0)) == 0 || (*pte & PTE_V) == 0)
+    panic("mapframe");
+  *pte = PA2PTE(p->trapframe) | PTE_R | PTE_W | PTE_V;
+  if((pte = walk(pagetable, USYSCALL, 0)) == 0 || (*pte & PTE_V) == 0)
+    panic("mapframe");
+  *pte = PA2PTE(p->usyscall) | PTE_R | PTE_U | PTE_V;
+}
+
+// Create a child that runs in the parent's address space,
+// borrowing its page table instead of copying its memory,
+// until the child calls exec() or exit(). The parent sleeps
+// until then, so only one of them uses the page table at a
+// time; kswapd leaves both alone meanwhile. The page table
+// stays the parent's: freeproc() and exec() never free it
+// for the child.
+int
+vfork(void)
+{
+  int i, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  // p's threads would go on using the page table.
+  if(p->uspace)
+    return fork();
+
+  if((np = allocproc()) == 0){
+    return -1;
+  }
+  release(&np->lock);
+
+  // drop np's own page table for p's. the trap path finds
+  // the trapframe at TRAPFRAME, so point that, and USYSCALL,
+  // at np's pages until the page table is given back; p does
+  // not use them, since it stays in the kernel.
+  proc_freepagetable(np->pagetable, 0);
+  np->pagetable = p->pagetable;
+  np->sz = p->sz;
+  np->vforkparent = p;
+  mapframe(p->pagetable, np);
+
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->a0 = 0;
+  for(i = 0; i < NOFILE; i++)
+    if(p->ofile[i])
+      np->ofile[i] = filedup(p->ofile[i]);
+  np->cwd = idup(p->cwd);
+  safestrcpy(np->name, p->name, sizeof(p->name));
+  pid = np->pid;
+
+  acquire(&p->lock);
+  p->vforkwait = 1;
+  release(&p->lock);
+
+  acquire(&np->lock);
+  np->parent = p;
+  np->state = RUNNABLE;
+  release(&np->lock);
+
+  // wait, even if killed, for the page table to come back.
+  acquire(&p->lock);
+  while(p->vforkwait)
+    sleep(p, &p->lock);
+  release(&p->lock);
+
+  return pid;
+}
+
+// Give the page table that p borrowed with vfork() back to
+// the parent, which will find its memory sz bytes long, and
+// wake the parent. Called by exec() and exit().
+void
+vforkdone(struct proc *p, uint64 sz)
+{
+  struct proc *pp = p->vforkparent;
+
+  mapframe(pp->pagetable, pp);
+  pp->sz = sz;
+  p->vforkparent = 0;
+  acquire(&pp->lock);
+  pp->vforkwait = 0;
+  wakeup1(pp);
+  release(&pp->lock);
+}
+
+// Create a thread: a child that shares the caller's page table,
+// and so its memory, and starts at fn(arg) with its stack
+// pointer at stack. It has its own kernel stack, copy of the
+// file table, and trapframe, mapped at UTRAPFRAME(i) for a slot
+// i that no other thread is using. Threads see the caller's
+// USYSCALL page. Returns the thread's pid, or -1.
+int
+clone(uint64 fn, uint64 arg, uint64 stack)
+{
+  int i, slot, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+  struct uspace *us;
+
+  if(p->vforkparent)
+    return -1;
+  for(i = 0; i < NSHMATT; i++)
+    if(p->shm[i].seg)
+      return -1;  // see shm.c
+  if((us = p->uspace) == 0){
+    if((us = (struct uspace*)slaballoc(&uspacecache)) == 0)
+      return -1;
+    initsleeplock(&us->lock, "uspace");
+    us->ref = 1;
+    us->slots = 0;
+    us->trapframe = 0;
+    p->uspace = us;
+  }
+
+  acquire(&uspacelock);
+  for(slot = 0; slot < NTHREAD; slot++)
+    if((us->slots & (1 << slot)) == 0)
+      break;
+  if(slot == NTHREAD){
+    release(&uspacelock);
+    return -1;
+  }
+  us->slots |= 1 << slot;
+  us->ref++;
+  release(&uspacelock);
+
+  if((np = allocproc()) == 0)
+    goto bad;
+  // as in fork(), np is USED, so no one else touches it.
+  release(&np->lock);
+
+  proc_freepagetable(np->pagetable, 0);
+  np->pagetable = 0;
+  kfree((void*)np->usyscall);
+  np->usyscall = p->usyscall;
+
+  acquiresleep(&us->lock);
+  if(mappages(p->pagetable, UTRAPFRAME(slot), PGSIZE,
+              (uint64)np->trapframe, PTE_R | PTE_W) < 0){
+    releasesleep(&us->lock);
+    acquire(&np->lock);
+    np->usyscall = 0;
+    freeproc(np);
+    release(&np->lock);
+    goto bad;
+  }
+  np->pagetable = p->pagetable;
+  np->sz = p->sz;  // growproc() keeps it up to date from now on
+  np->uspace = us;
+  np->trapva = UTRAPFRAME(slot);
+  releasesleep(&us->lock);
+
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = arg;
+  np->trapframe->sp = stack;
+  for(i = 0; i < NOFILE; i++)
+    if(p->ofile[i])
+      np->ofile[i] = filedup(p->ofile[i]);
+  np->cwd = idup(p->cwd);
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  acquire(&np->lock);
+  np->parent = p;
+  pid = np->pid;
+  np->state = RUNNABLE;
+  release(&np->lock);
+  return pid;
+
+ bad:
+  acquire(&uspacelock);
+  us->slots &= ~(1 << slot);
+  us->ref--;
+  release(&uspacelock);
+  uspacedrop(p);
+  return -1;
+}
+
+// Take p out of its shared address space, whose page table
+// is pagetable. Returns 1 if p was the last member, and the
+// caller should free pagetable; then p keeps the page mapped at
+// USYSCALL. Else returns 0, and what the others still use stays
+// mapped: if p made the threads, its trapframe at TRAPFRAME
+// and its USYSCALL page. Called by freeproc() and exec().
+int
+uspaceleave(struct proc *p, pagetable_t pagetable)
+{
+  struct uspace *us = p->uspace;
+  int last;
+
+  if(p->trapva != TRAPFRAME)
+    uvmunmap(pagetable, p->trapva, 1, 0);
+  acquire(&uspacelock);
+  if(p->trapva != TRAPFRAME)
+    us->slots &= ~(1 << SLOT(p->trapva));
+  last = --us->ref == 0;
+  p->uspace = 0;
+  release(&uspacelock);
+
+  if(last){
+    if(us->trapframe)
+      kfree((void*)us->trapframe);
+    p->usyscall->pid = p->pid;
+    slabfree(&uspacecache, us);
+  } else if(p->trapva == TRAPFRAME){
+    us->trapframe = p->trapframe;
+    p->trapframe = 0;
+    p->usyscall = 0;
+  } else
+    p->usyscall = 0;
+  p->trapva = TRAPFRAME;
+  return last;
+}
+
+// If p made its address space and is now its only member,
+// make it an ordinary process again. Called by p itself, so
+// no one else can add a member meanwhile.
+void
+uspacedrop(struct proc *p)
+{
+  struct uspace *us = p->uspace;
+  int alone;
+
+  if(us == 0 || p->trapva != TRAPFRAME)
+    return;
+  // kswapd reads p->uspace under p->lock, and growproc()
+  // under uspacelock.
+  acquire(&p->lock);
+  acquire(&uspacelock);
+  if((alone = us->ref == 1) != 0)
+    p->uspace = 0;
+  release(&uspacelock);
+  release(&p->lock);
+  if(alone)
+    slabfree(&uspacecache, us);
+}
+
+// Does p share its address space with other threads?
+int
+uspaceshared(struct proc *p)
+{
+  int shared;
+
+  if(p->uspace == 0)
+    return 0;
+  acquire(&uspacelock);
+  shared = p->uspace->ref > 1;
+  release(&uspacelock);
+  return shared;
+}
+
+// Set np's file descriptor fd to f, closing what was there.
+static void
+setfd(struct proc *np, int fd, struct file *f)
+{
+  if(np->ofile[fd])
+    fileclose(np->ofile[fd]);
+  np->ofile[fd] = f;
+}
+
+// Create a new child process running path with argv, like
+// fork() followed by exec() in the child, but without ever
+// copying the caller's memory. The child's file descriptors
+// are the caller's, changed by the nact actions in acts.
+// Returns the child's pid, or -1 if any action or the exec
+// fails.
+int
+spawn(char *path, char **argv, struct spawnact *acts, int nact)
+{
+  int i, fd, argc, pid;
+  char apath[MAXPATH];
+  struct file *f;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if((np = allocproc()) == 0)
+    return -1;
+  // as in fork(), np is USED, so no one else touches it.
+  release(&np->lock);
+
+  for(i = 0; i < NOFILE; i++)
+    if(p->ofile[i])
+      np->ofile[i] = filedup(p->ofile[i]);
+  np->cwd = idup(p->cwd);
+
+  for(i = 0; i < nact; i++){
+    fd = acts[i].fd;
+    if(fd < 0 || fd >= NOFILE)
+      goto bad;
+    switch(acts[i].op){
+    case SPAWN_CLOSE:
+      setfd(np, fd, 0);
+      break;
+    case SPAWN_DUP:
+      if(acts[i].src < 0 || acts[i].src >= NOFILE || np->ofile[acts[i].src] == 0)
+        goto bad;
+      if(acts[i].src != fd)
+        setfd(np, fd, filedup(np->ofile[acts[i].src]));
+      break;
+    case SPAWN_OPEN:
+      if(fetchstr((uint64)acts[i].path, apath, MAXPATH) < 0)
+        goto bad;
+      if((f = fileopen(apath, acts[i].mode)) == 0)
+        goto bad;
+      setfd(np, fd, f);
+      break;
+    default:
+      goto bad;
+    }
+  }
+
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+  if((argc = execproc(np, path, argv)) < 0)
+    goto bad;
+  np->trapframe->a0 = argc;
+
+  acquire(&np->lock);
+  np->parent = p;
+  pid = np->pid;
+  np->state = RUNNABLE;
+  release(&np->lock);
+  return pid;
+
+ bad:
+  for(i = 0; i < NOFILE; i++)
+    setfd(np, i, 0);
+  begin_op();
+  iput(np->cwd);
+  end_op();
+  np->cwd = 0;
+  acquire(&np->lock);
+  freeproc(np);
+  release(&np->lock);
+  return -1;
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold p->lock.
 void
@@ -328,7 +768,7 @@ reparent(struct proc *p)
 
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
-// until its parent calls wait().
+// until its parent calls wait(), or join() for a thread.
 void
 exit(int status)
 {
@@ -337,6 +777,18 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
+  // a vfork() child hands back the parent's page table.
+  if(p->vforkparent){
+    uint64 sz = p->sz;
+    acquire(&p->lock);
+    p->pagetable = 0;
+    p->sz = 0;
+    release(&p->lock);
+    vforkdone(p, sz);
+  }
+
+  shmdetachall(p, p->pagetable);
+
   // Close all open files.
   for(int fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd]){
@@ -396,9 +848,41 @@ exit(int status)
 // Return -1 if this process has no children.
 int
 wait(uint64 addr)
+{
+  return waitfor(0, addr);
+}
+
+// Wait for the thread tid, a child made by clone(), to exit,
+// and return tid. Return -1 if there is no such thread.
+int
+join(int tid, uint64 addr)
+{
+  if(tid <= 0)
+    return -1;
+  return waitfor(tid, addr);
+}
+
+// Is np a child that waitfor(tid) should wait for? wait()
+// leaves threads to join(), except that init, which inherits
+// the threads of processes that exit, reaps them too.
+static int
+waitable(struct proc *p, struct proc *np, int tid)
+{
+  if(np->parent != p)
+    return 0;
+  if(tid)
+    return np->pid == tid && np->trapva != TRAPFRAME;
+  return np->trapva == TRAPFRAME || p == initproc;
+}
+
+// Wait for a child to exit: thread tid if tid is non-zero, else
+// any child that waitable() allows. Return its pid, or -1 if
+// there is none.
+static int
+waitfor(int tid, uint64 addr)
 {
   struct proc *np;
-  int havekids, pid;
+  int havekids, pid, xstate;
   struct proc *p = myproc();
 
   // hold p->lock for the whole time to avoid lost
@@ -412,7 +896,7 @@ wait(uint64 addr)
       // this code uses np->parent without holding np->lock.
       // acquiring the lock first would cause a deadlock,
       // since np might be an ancestor, and we already hold p->lock.
-      if(np->parent == p){
+      if(waitable(p, np, tid)){
         // np->parent can't change between the check and the acquire()
         // because only the parent changes it, and we're the parent.
         acquire(&np->lock);
@@ -420,15 +904,16 @@ wait(uint64 addr)
         if(np->state == ZOMBIE){
           // Found one.
           pid = np->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-            release(&np->lock);
-            release(&p->lock);
-            return -1;
-          }
+          xstate = np->xstate;
           freeproc(np);
           release(&np->lock);
           release(&p->lock);
+          uspacedrop(p);
+          // copyout() may have to swap a page in, which
+          // sleeps, so it must not be done holding p->lock.
+          if(addr != 0 && copyout(p->pagetable, addr, (char *)&xstate,
+                                  sizeof(xstate)) < 0)
+            return -1;
           return pid;
         }
         release(&np->lock);
@@ -549,6 +1034,35 @@ forkret(void)
   usertrapret();
 }
 
+// Start a kernel thread that runs fn() in the kernel,
+// with its own proc and kernel stack, so that fn() can
+// sleep. fn() must never return.
+void
+kthreadcreate(void (*fn)(void), char *name)
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kthreadcreate");
+  p->kfn = fn;
+  p->context.ra = (uint64)kthreadret;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->state = RUNNABLE;
+  release(&p->lock);
+}
+
+// A kernel thread's very first scheduling by scheduler()
+// will swtch to kthreadret.
+static void
+kthreadret(void)
+{
+  // Still holding p->lock from scheduler.
+  release(&myproc()->lock);
+
+  myproc()->kfn();
+  panic("kthreadret");
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
@@ -599,6 +1113,68 @@ wakeup(void *chan)
   }
 }
 
+// Find the physical address of the int at user address addr,
+// which is how futexes are named, so that threads, and processes
+// attached to the same shared memory segment, share futexes.
+// Returns 0 if addr is not mapped or not aligned.
+static uint64
+futexaddr(uint64 addr)
+{
+  uint64 pa;
+
+  if(addr % sizeof(int) != 0 || (pa = walkaddrin(myproc()->pagetable, addr)) == 0)
+    return 0;
+  return pa + addr % PGSIZE;
+}
+
+// Sleep until futexwake() on addr, if the int at addr is still
+// val. Returns 0 once woken, which may be spuriously, or -1 if
+// the value differs or the process was killed. kswapd could
+// move the page while we sleep only if it is private to this
+// process, in which case nothing could wake us anyway.
+int
+futexwait(uint64 addr, int val)
+{
+  struct proc *p = myproc();
+  uint64 pa;
+
+  if((pa = futexaddr(addr)) == 0)
+    return -1;
+  acquire(&futexlock);
+  if(*(int*)pa != val || p->killed){
+    release(&futexlock);
+    return -1;
+  }
+  sleep((void*)pa, &futexlock);
+  release(&futexlock);
+  return 0;
+}
+
+// Wake up to n processes sleeping in futexwait() on addr.
+// Returns the number woken.
+int
+futexwake(uint64 addr, int n)
+{
+  struct proc *pp;
+  uint64 pa;
+  int woken;
+
+  if((pa = futexaddr(addr)) == 0)
+    return -1;
+  woken = 0;
+  acquire(&futexlock);
+  for(pp = proc; pp < &proc[NPROC] && woken < n; pp++){
+    acquire(&pp->lock);
+    if(pp->state == SLEEPING && pp->chan == (void*)pa){
+      pp->state = RUNNABLE;
+      woken++;
+    }
+    release(&pp->lock);
+  }
+  release(&futexlock);
+  return woken;
+}
+
 // Wake up p if it is sleeping in wait(); used by exit().
 // Caller must hold p->lock.
 static void
@@ -673,6 +1249,7 @@ procdump(void)
 {
   static char *states[] = {
   [UNUSED]    "unused",
+  [USED]      "used  ",
   [SLEEPING]  "sleep ",
   [RUNNABLE]  "runble",
   [RUNNING]   "run   ",
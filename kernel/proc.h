@@ -80,7 +80,13 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
-enum procstate { UNUSED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
+// A shared memory segment attached to a process; see shm.c.
+struct shmatt {
+  struct shm *seg;             // the segment, or 0 if this entry is free
+  uint64 va;                   // where it is mapped
+};
+
+enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
 struct proc {
@@ -93,14 +99,24 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int kpreempted;              // If non-zero, preempted while in the kernel
+  int vforkwait;               // If non-zero, a vfork() child has our page table
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
+  struct usyscall *usyscall;   // data page mapped at USYSCALL
+  struct ring *ring;           // page mapped at URING, or 0
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
+  struct shmatt shm[NSHMATT];  // Attached shared memory segments
   struct inode *cwd;           // Current directory
+  int logres;                  // Log blocks reserved by begin_opn()
   char name[16];               // Process name (debugging)
+  void (*kfn)(void);           // Body of a kernel thread, else 0
+  struct proc *vforkparent;    // Lent us its page table, else 0
+  struct uspace *uspace;       // Address space shared with threads, else 0
+  uint64 trapva;               // Where trapframe is mapped: TRAPFRAME, or UTRAPFRAME(i) in a thread
 };
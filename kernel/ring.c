@@ -0,0 +1,115 @@
+// Submission and completion rings, so that a process can
+// queue many file operations and have them carried out with
+// a single system call.
+//
+// ringsetup() maps a struct ring (ring.h) into the process at
+// URING. The process fills in submissions and advances sqtail,
+// then calls ringenter(), which runs the queued operations in
+// order and posts a completion for each. The operations run
+// synchronously, one after another, in the calling process;
+// what the ring saves is the trap per operation.
+//
+// The ring page is writable by the process, so the kernel
+// copies each submission before looking at it and trusts
+// none of the indices beyond taking them modulo the queue size.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "ring.h"
+
+// Carry out one submission and return its result.
+static int
+ringop(struct ringsqe *sqe)
+{
+  char path[MAXPATH];
+  struct file *f;
+
+  switch(sqe->op){
+  case RING_NOP:
+    return 0;
+  case RING_READ:
+    if((f = fdfile(sqe->fd)) == 0)
+      return -1;
+    return fileread(f, sqe->addr, sqe->n);
+  case RING_WRITE:
+    if((f = fdfile(sqe->fd)) == 0)
+      return -1;
+    return filewrite(f, sqe->addr, sqe->n);
+  case RING_OPEN:
+    if(fetchstr(sqe->addr, path, MAXPATH) < 0)
+      return -1;
+    return fdopen(path, sqe->n);
+  case RING_CLOSE:
+    return fdclose(sqe->fd);
+  case RING_FSYNC:
+    // the log is the only write cache to flush; a
+    // committed transaction survives a crash.
+    if(fdfile(sqe->fd) == 0)
+      return -1;
+    log_force();
+    return 0;
+  }
+  return -1;
+}
+
+// Map a ring page at URING, if there is none yet.
+// Returns URING, or -1 if out of memory.
+uint64
+sys_ringsetup(void)
+{
+  struct proc *p = myproc();
+  struct ring *r;
+
+  if(p->ring)
+    return URING;
+  uspacedrop(p);
+  // threads share one URING mapping, and a vfork() child's
+  // page table is its parent's.
+  if(p->uspace || p->vforkparent)
+    return -1;
+  if((r = (struct ring*)kalloc()) == 0)
+    return -1;
+  memset(r, 0, PGSIZE);
+  if(mappages(p->pagetable, URING, PGSIZE, (uint64)r, PTE_R | PTE_W | PTE_U) < 0){
+    kfree(r);
+    return -1;
+  }
+  p->ring = r;
+  return URING;
+}
+
+// Run up to n queued submissions, stopping early if the
+// completion queue fills. Returns the number run, or -1
+// if there is no ring.
+uint64
+sys_ringenter(void)
+{
+  struct proc *p = myproc();
+  struct ring *r = p->ring;
+  struct ringsqe sqe;
+  struct ringcqe *cqe;
+  int n, i;
+  uint head;
+
+  if(argint(0, &n) < 0 || r == 0)
+    return -1;
+
+  for(i = 0; i < n && r->sqhead != r->sqtail && !p->killed; i++){
+    if(r->cqtail - r->cqhead >= NRINGCQE)
+      break;
+    head = r->sqhead;
+    sqe = r->sq[head % NRINGSQE];
+    r->sqhead = head + 1;
+
+    cqe = &r->cq[r->cqtail % NRINGCQE];
+    cqe->res = ringop(&sqe);
+    cqe->tag = sqe.tag;
+    r->cqtail++;
+  }
+  return i;
+}
@@ -0,0 +1,41 @@
+// Submission and completion rings, shared between a process
+// and the kernel in the page that ringsetup() maps at URING.
+
+#define NRINGSQE 64    // submission queue entries
+#define NRINGCQE 64    // completion queue entries
+
+// operations
+#define RING_NOP   0
+#define RING_READ  1   // read(fd, addr, n)
+#define RING_WRITE 2   // write(fd, addr, n)
+#define RING_OPEN  3   // open(addr, n)
+#define RING_CLOSE 4   // close(fd)
+#define RING_FSYNC 5   // wait until fd's writes are on disk
+
+struct ringsqe {
+  int op;                     // RING_xxx
+  int fd;
+  uint64 addr;                // user buffer or path
+  int n;                      // byte count, or open mode
+  int pad;
+  uint64 tag;                 // copied to the completion
+};
+
+struct ringcqe {
+  uint64 tag;                 // from the submission
+  int res;                    // what the system call would return
+  int pad;
+};
+
+// The process adds submissions at sqtail and takes completions
+// at cqhead; the kernel takes submissions at sqhead and adds
+// completions at cqtail. Indices only grow, and are taken
+// modulo the queue size.
+struct ring {
+  uint sqhead;
+  uint sqtail;
+  uint cqhead;
+  uint cqtail;
+  struct ringsqe sq[NRINGSQE];
+  struct ringcqe cq[NRINGCQE];
+};
@@ -0,0 +1,265 @@
+// Shared memory segments.
+//
+// A segment is a named set of pages. shmat() attaches it to
+// the calling process, at an address the process chooses or one
+// the kernel picks, in [USHM, USHMEND), creating the segment
+// first if there is none of that name. Each attachment takes a
+// kref() reference to every page of the segment, so a page is
+// freed only once the segment is gone and no page table maps
+// it. fork() copies a process's attachments; exec() and exit()
+// detach them all. A segment goes away with its last attachment.
+//
+// Attachments are kept per process, not per address space, so
+// a process with threads cannot attach segments, nor can one
+// with attachments make threads. kswapd never evicts segment
+// pages, since it only looks below p->sz.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+
+struct shm {
+  char name[SHMNAME];
+  int npages;               // pages in the segment; 0 if unused
+  int nattach;              // attachments, in all processes
+  uint64 pages[SHMPAGES];
+};
+
+struct {
+  struct sleeplock lock;    // attaching may sleep for memory
+  struct shm seg[NSHM];
+} shmtab;
+
+void
+shminit(void)
+{
+  initsleeplock(&shmtab.lock, "shm");
+}
+
+// Make a segment of npages zeroed pages called name.
+// Returns 0 if the table is full or memory is short.
+// Caller must hold shmtab.lock.
+static struct shm*
+shmcreate(char *name, int npages)
+{
+  struct shm *seg;
+  int i;
+
+  for(seg = shmtab.seg; seg < &shmtab.seg[NSHM]; seg++)
+    if(seg->npages == 0)
+      break;
+  if(seg == &shmtab.seg[NSHM])
+    return 0;
+  for(i = 0; i < npages; i++){
+    if((seg->pages[i] = (uint64)kallocwait()) == 0){
+      while(--i >= 0)
+        kfree((void*)seg->pages[i]);
+      return 0;
+    }
+    memset((void*)seg->pages[i], 0, PGSIZE);
+  }
+  safestrcpy(seg->name, name, SHMNAME);
+  seg->npages = npages;
+  seg->nattach = 0;
+  return seg;
+}
+
+// Free a segment that has no attachments left.
+// Caller must hold shmtab.lock.
+static void
+shmfree(struct shm *seg)
+{
+  int i;
+
+  for(i = 0; i < seg->npages; i++)
+    kfree((void*)seg->pages[i]);
+  seg->npages = 0;
+}
+
+// Map seg's pages at va in pagetable, taking a reference to
+// each. Returns 0, or -1 with nothing mapped if out of memory.
+static int
+shmmap(pagetable_t pagetable, struct shm *seg, uint64 va)
+{
+  int i;
+
+  for(i = 0; i < seg->npages; i++){
+    kref((void*)seg->pages[i]);
+    if(mappages(pagetable, va + i*PGSIZE, PGSIZE, seg->pages[i],
+                PTE_R | PTE_W | PTE_U) < 0){
+      kfree((void*)seg->pages[i]);
+      if(i > 0)
+        uvmunmap(pagetable, va, i, 1);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Does [va, va + npages pages) overlap an attachment of p's?
+// Returns the end of the first one it overlaps, or 0.
+static uint64
+shmoverlap(struct proc *p, uint64 va, int npages)
+{
+  struct shmatt *a;
+  uint64 end;
+
+  for(a = p->shm; a < &p->shm[NSHMATT]; a++){
+    if(a->seg == 0)
+      continue;
+    end = a->va + a->seg->npages*PGSIZE;
+    if(va < end && a->va < va + npages*PGSIZE)
+      return end;
+  }
+  return 0;
+}
+
+// Attach the segment called name at va, or at the lowest free
+// address in p's shared memory area if va is 0, creating the
+// segment with npages pages if there is none. An existing
+// segment must have npages pages. Returns the address, or -1.
+uint64
+shmattach(char *name, int npages, uint64 va)
+{
+  struct proc *p = myproc();
+  struct shmatt *a;
+  struct shm *seg, *s;
+  uint64 end;
+
+  uspacedrop(p);
+  if(npages <= 0 || npages > SHMPAGES || p->uspace || p->vforkparent)
+    return -1;
+  for(a = p->shm; a < &p->shm[NSHMATT]; a++)
+    if(a->seg == 0)
+      break;
+  if(a == &p->shm[NSHMATT])
+    return -1;
+  if(va == 0){
+    va = USHM;
+    while((end = shmoverlap(p, va, npages)) != 0)
+      va = end;
+  } else if(va % PGSIZE != 0 || va < USHM)
+    return -1;
+  // written so that a va near 2^64 cannot wrap around.
+  if(va >= USHMEND || npages > (USHMEND - va) / PGSIZE || shmoverlap(p, va, npages))
+    return -1;
+
+  acquiresleep(&shmtab.lock);
+  seg = 0;
+  for(s = shmtab.seg; s < &shmtab.seg[NSHM]; s++){
+    if(s->npages && strncmp(s->name, name, SHMNAME) == 0){
+      seg = s;
+      break;
+    }
+  }
+  if(seg && seg->npages != npages)
+    goto bad;
+  if(seg == 0 && (seg = shmcreate(name, npages)) == 0)
+    goto bad;
+  if(shmmap(p->pagetable, seg, va) < 0){
+    if(seg->nattach == 0)
+      shmfree(seg);
+    goto bad;
+  }
+  seg->nattach++;
+  a->seg = seg;
+  a->va = va;
+  releasesleep(&shmtab.lock);
+  return va;
+
+ bad:
+  releasesleep(&shmtab.lock);
+  return -1;
+}
+
+// Unmap attachment a of p's from pagetable, and free the
+// segment if that was its last attachment.
+static void
+shmdrop(struct shmatt *a, pagetable_t pagetable)
+{
+  acquiresleep(&shmtab.lock);
+  uvmunmap(pagetable, a->va, a->seg->npages, 1);
+  if(--a->seg->nattach == 0)
+    shmfree(a->seg);
+  releasesleep(&shmtab.lock);
+  a->seg = 0;
+  a->va = 0;
+}
+
+// Detach the segment attached at va. Returns 0, or -1 if
+// there is none.
+int
+shmdetach(uint64 va)
+{
+  struct proc *p = myproc();
+  struct shmatt *a;
+
+  for(a = p->shm; a < &p->shm[NSHMATT]; a++){
+    if(a->seg && a->va == va){
+      shmdrop(a, p->pagetable);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// Detach all of p's segments, which are mapped in pagetable.
+// Called by exec() and exit().
+void
+shmdetachall(struct proc *p, pagetable_t pagetable)
+{
+  struct shmatt *a;
+
+  for(a = p->shm; a < &p->shm[NSHMATT]; a++)
+    if(a->seg)
+      shmdrop(a, pagetable);
+}
+
+// Attach p's segments to np at the same addresses, for fork().
+// Returns -1 if out of memory; np may then have some of them.
+int
+shmfork(struct proc *p, struct proc *np)
+{
+  int i;
+
+  acquiresleep(&shmtab.lock);
+  for(i = 0; i < NSHMATT; i++){
+    if(p->shm[i].seg == 0)
+      continue;
+    if(shmmap(np->pagetable, p->shm[i].seg, p->shm[i].va) < 0){
+      releasesleep(&shmtab.lock);
+      return -1;
+    }
+    p->shm[i].seg->nattach++;
+    np->shm[i] = p->shm[i];
+  }
+  releasesleep(&shmtab.lock);
+  return 0;
+}
+
+uint64
+sys_shmat(void)
+{
+  char name[SHMNAME];
+  int npages;
+  uint64 va;
+
+  if(argstr(0, name, SHMNAME) < 0 || argint(1, &npages) < 0 || argaddr(2, &va) < 0)
+    return -1;
+  return shmattach(name, npages, va);
+}
+
+uint64
+sys_shmdt(void)
+{
+  uint64 va;
+
+  if(argaddr(0, &va) < 0)
+    return -1;
+  return shmdetach(va);
+}
@@ -0,0 +1,236 @@
+// Slab allocator for small, fixed-size kernel objects
+// (pipes, open files, in-memory inodes).
+//
+// Each cache hands out objects of one size. Objects live in
+// slabs: whole pages from kalloc(), with a struct slab header
+// at the start of the page and the objects packed after it,
+// so the slab owning an object is found by rounding the
+// object's address down to a page boundary.
+//
+// Every CPU keeps a small magazine of free objects per cache.
+// slaballoc() and slabfree() normally just pop or push the
+// current CPU's magazine, whose lock no other CPU takes in the
+// common case. Only when a magazine runs empty or full is the
+// cache lock taken, to move half a magazine's worth of objects
+// between the magazine and the slabs.
+//
+// When kalloc() runs out of pages it calls slabreclaim(), which
+// empties every magazine and gives empty slabs back.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "slab.h"
+#include "defs.h"
+
+struct slab {
+  struct slab *next;  // next slab on cache's partial list
+  void *free;         // free objects in this slab
+  uint inuse;         // objects handed out (including to magazines)
+};
+
+#define SLABHDR ((sizeof(struct slab) + 15) & ~15)
+
+static struct slabcache *caches;  // all caches, linked by next
+
+void
+initslab(struct slabcache *c, char *name, uint size)
+{
+  initlock(&c->lock, "slab");
+  c->name = name;
+  c->size = (size + 15) & ~15;
+  c->perslab = (PGSIZE - SLABHDR) / c->size;
+  if(c->perslab == 0)
+    panic("initslab: object too big");
+  c->partial = 0;
+  c->nslab = 0;
+  for(int i = 0; i < NCPU; i++){
+    initlock(&c->mag[i].lock, "magazine");
+    c->mag[i].n = 0;
+  }
+  // caches are created during boot, before other CPUs run.
+  c->next = caches;
+  caches = c;
+}
+
+// Turn a fresh page into a slab on the partial list.
+// Caller must hold c->lock.
+static void
+slabgrow(struct slabcache *c, char *page)
+{
+  struct slab *s;
+  char *obj;
+
+  s = (struct slab*)page;
+  s->free = 0;
+  s->inuse = 0;
+  obj = page + SLABHDR;
+  for(int i = 0; i < c->perslab; i++, obj += c->size){
+    *(void**)obj = s->free;
+    s->free = obj;
+  }
+  s->next = c->partial;
+  c->partial = s;
+  c->nslab++;
+}
+
+// Take one object out of the slabs, or return 0
+// if no slab has a free object.
+// Caller must hold c->lock.
+static void*
+slabget(struct slabcache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  if((s = c->partial) == 0)
+    return 0;
+  obj = s->free;
+  s->free = *(void**)obj;
+  s->inuse++;
+  if(s->free == 0)
+    c->partial = s->next;  // slab is now full
+  return obj;
+}
+
+// Return one object to its slab, giving the page back to
+// kalloc() if the slab is now empty and is not the only
+// slab with free objects.
+// Caller must hold c->lock.
+static void
+slabput(struct slabcache *c, void *obj)
+{
+  struct slab *s, **pp;
+
+  s = (struct slab*)PGROUNDDOWN((uint64)obj);
+  if(s->free == 0){
+    // was full, so not on the partial list.
+    s->next = c->partial;
+    c->partial = s;
+  }
+  *(void**)obj = s->free;
+  s->free = obj;
+  s->inuse--;
+
+  if(s->inuse == 0 && (c->partial != s || s->next != 0)){
+    for(pp = &c->partial; *pp != s; pp = &(*pp)->next)
+      ;
+    *pp = s->next;
+    c->nslab--;
+    kfree((void*)s);
+  }
+}
+
+// Lock and return the current CPU's magazine for cache c.
+static struct magazine*
+mymag(struct slabcache *c)
+{
+  struct magazine *m;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  acquire(&m->lock);
+  pop_off();
+  return m;
+}
+
+// Allocate a zeroed object from cache c.
+// Returns 0 if the memory cannot be allocated.
+void*
+slaballoc(struct slabcache *c)
+{
+  struct magazine *m;
+  void *obj;
+  char *page;
+
+  for(;;){
+    m = mymag(c);
+    if(m->n == 0){
+      // magazine empty: refill half of it from the slabs.
+      acquire(&c->lock);
+      while(m->n < MAGSIZE/2 && (obj = slabget(c)) != 0)
+        m->obj[m->n++] = obj;
+      release(&c->lock);
+    }
+    if(m->n > 0){
+      obj = m->obj[--m->n];
+      release(&m->lock);
+      memset(obj, 0, c->size);
+      return obj;
+    }
+    release(&m->lock);
+
+    // no free objects: add a slab. kalloc() may call
+    // slabreclaim(), so no slab locks may be held here.
+    if((page = kalloc()) == 0)
+      return 0;
+    acquire(&c->lock);
+    slabgrow(c, page);
+    release(&c->lock);
+  }
+}
+
+// Free an object that was allocated from cache c.
+void
+slabfree(struct slabcache *c, void *obj)
+{
+  struct magazine *m;
+
+  m = mymag(c);
+  if(m->n < MAGSIZE){
+    m->obj[m->n++] = obj;
+    release(&m->lock);
+    return;
+  }
+
+  // magazine full: return half of it to the slabs.
+  acquire(&c->lock);
+  while(m->n > MAGSIZE/2)
+    slabput(c, m->obj[--m->n]);
+  slabput(c, obj);
+  release(&c->lock);
+  release(&m->lock);
+}
+
+// Give memory held by the slab caches back to kalloc():
+// empty every CPU's magazines, then free every empty slab.
+// Returns the number of pages freed.
+int
+slabreclaim(void)
+{
+  struct slabcache *c;
+  struct magazine *m;
+  struct slab *s, **pp;
+  int n, freed;
+
+  freed = 0;
+  for(c = caches; c; c = c->next){
+    for(int i = 0; i < NCPU; i++){
+      m = &c->mag[i];
+      acquire(&m->lock);
+      acquire(&c->lock);
+      n = c->nslab;
+      while(m->n > 0)
+        slabput(c, m->obj[--m->n]);
+      freed += n - c->nslab;
+      release(&c->lock);
+      release(&m->lock);
+    }
+
+    // slabput() keeps the last empty slab; free it too.
+    acquire(&c->lock);
+    for(pp = &c->partial; (s = *pp) != 0; ){
+      if(s->inuse == 0){
+        *pp = s->next;
+        c->nslab--;
+        kfree((void*)s);
+        freed++;
+      } else
+        pp = &s->next;
+    }
+    release(&c->lock);
+  }
+  return freed;
+}
@@ -0,0 +1,23 @@
+// Object caches for small, fixed-size kernel objects.
+
+#define MAGSIZE 16  // free objects each CPU keeps on hand per cache
+
+// Per-CPU stack of free objects. Its lock is normally taken
+// only by its own CPU, so it is not contended; slabreclaim()
+// takes it from other CPUs to empty the magazine.
+struct magazine {
+  struct spinlock lock;
+  int n;
+  void *obj[MAGSIZE];
+};
+
+struct slabcache {
+  struct spinlock lock;
+  char *name;            // Name of cache, for debugging.
+  uint size;             // Object size in bytes.
+  uint perslab;          // Objects in one slab page.
+  struct slab *partial;  // Slabs with at least one free object.
+  int nslab;             // Slab pages currently allocated.
+  struct slabcache *next; // All caches, for slabreclaim().
+  struct magazine mag[NCPU];
+};
@@ -1,4 +1,14 @@
 // Sleeping locks
+//
+// A sleeplock is held either exclusively by one process
+// (acquiresleep) or shared by any number of readers
+// (acquiresleepshared). A waiting writer holds off new
+// readers, so a stream of readers cannot starve it.
+//
+// A sleeplock is often held only briefly, e.g. a buffer while
+// its contents are copied. So if the exclusive holder is
+// running on another CPU, a waiter spins for a while before
+// it sleeps, saving the cost of a sleep() and wakeup().
 
 #include "types.h"
 #include "riscv.h"
@@ -9,24 +19,58 @@
 #include "proc.h"
 #include "sleeplock.h"
 
+#define SPINROUNDS 64    // spin at most this many times per acquire
+#define SPINLOOP   1000  // iterations per spin
+
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->nreaders = 0;
+  lk->nwriters = 0;
   lk->pid = 0;
+  lk->proc = 0;
+}
+
+// Spin for a while, without lk->lk, if the exclusive holder
+// of lk is running and so will probably release it soon.
+// Called and returns with lk->lk held. Returns 0 if the
+// caller should sleep instead.
+static int
+spinwait(struct sleeplock *lk, int *rounds)
+{
+  struct proc *p = lk->proc;
+  int i;
+
+  // p->state is read without p->lock; a stale
+  // value only makes the guess a bad one.
+  if(p == 0 || p == myproc() || p->state != RUNNING || *rounds >= SPINROUNDS)
+    return 0;
+  (*rounds)++;
+  release(&lk->lk);
+  for(i = 0; i < SPINLOOP && __atomic_load_n(&lk->locked, __ATOMIC_RELAXED); i++)
+    ;
+  acquire(&lk->lk);
+  return 1;
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  int rounds = 0;
+
   acquire(&lk->lk);
-  while (lk->locked) {
-    sleep(lk, &lk->lk);
+  lk->nwriters++;
+  while (lk->locked || lk->nreaders > 0) {
+    if(!spinwait(lk, &rounds))
+      sleep(lk, &lk->lk);
   }
+  lk->nwriters--;
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  lk->proc = myproc();
   release(&lk->lk);
 }
 
@@ -36,10 +80,39 @@ releasesleep(struct sleeplock *lk)
   acquire(&lk->lk);
   lk->locked = 0;
   lk->pid = 0;
+  lk->proc = 0;
   wakeup(lk);
   release(&lk->lk);
 }
 
+// Acquire lk shared with other readers. The caller
+// must not already hold lk, shared or not.
+void
+acquiresleepshared(struct sleeplock *lk)
+{
+  int rounds = 0;
+
+  acquire(&lk->lk);
+  while (lk->locked || lk->nwriters > 0) {
+    if(!spinwait(lk, &rounds))
+      sleep(lk, &lk->lk);
+  }
+  lk->nreaders++;
+  release(&lk->lk);
+}
+
+void
+releasesleepshared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  if(lk->nreaders <= 0)
+    panic("releasesleepshared");
+  if(--lk->nreaders == 0)
+    wakeup(lk);
+  release(&lk->lk);
+}
+
+// Does this process hold lk exclusively?
 int
 holdingsleep(struct sleeplock *lk)
 {
@@ -51,5 +124,15 @@ holdingsleep(struct sleeplock *lk)
   return r;
 }
 
+// Is lk held shared? Readers are not recorded,
+// so this cannot tell whether it is by this process.
+int
+holdingsleepshared(struct sleeplock *lk)
+{
+  int r;
 
-
+  acquire(&lk->lk);
+  r = lk->nreaders > 0;
+  release(&lk->lk);
+  return r;
+}
@@ -1,10 +1,13 @@
 // Long-term locks for processes
 struct sleeplock {
-  uint locked;       // Is the lock held?
+  uint locked;       // Is the lock held exclusively?
+  int nreaders;      // Number of shared holders
+  int nwriters;      // Waiting for exclusive; new readers wait too
   struct spinlock lk; // spinlock protecting this sleep lock
   
   // For debugging:
   char *name;        // Name of lock.
-  int pid;           // Process holding lock
+  int pid;           // Process holding lock exclusively
+  struct proc *proc; // Likewise, for adaptive spinning
 };
 
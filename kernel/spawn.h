@@ -0,0 +1,14 @@
+// File descriptor actions for spawn(), applied in order to
+// the new process's descriptors, which start as copies of
+// the caller's.
+#define SPAWN_CLOSE 1  // close fd
+#define SPAWN_DUP   2  // make fd refer to the same file as src
+#define SPAWN_OPEN  3  // open path with flags mode as fd
+
+struct spawnact {
+  int op;        // SPAWN_CLOSE, SPAWN_DUP or SPAWN_OPEN
+  int fd;        // the descriptor to change
+  int src;       // SPAWN_DUP: the descriptor to copy
+  int mode;      // SPAWN_OPEN: open() flags
+  char *path;    // SPAWN_OPEN: file to open
+};
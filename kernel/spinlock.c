@@ -1,4 +1,10 @@
 // Mutual exclusion spin locks.
+//
+// Every acquire() is counted, along with the number of times
+// the CPU had to spin because another CPU held the lock. Counts
+// are kept per lock name ("class"), since many locks (one per
+// proc, pipe, buffer, ...) share a name, and separately for each
+// CPU, so that counting doesn't make CPUs share a cache line.
 
 #include "types.h"
 #include "param.h"
@@ -6,14 +12,54 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "proc.h"
+#include "kstat.h"
 #include "defs.h"
 
+struct lockcount {
+  uint64 nacquire;
+  uint64 ncontended;
+  uint64 nspin;
+};
+
+// class 0 is the lock that protects the class table itself.
+static struct spinlock classlock = { .name = "lockclass" };
+static char *classname[NLOCKCLASS] = { "lockclass" };
+static int nclass = 1;
+static struct lockcount lockcount[NCPU][NLOCKCLASS];
+
+// Find or create the statistics class for locks named name.
+// Locks of a name that doesn't fit share the last class.
+static int
+lockclass(char *name)
+{
+  int i;
+
+  acquire(&classlock);
+  for(i = 0; i < nclass; i++)
+    if(classname[i] == name || strncmp(classname[i], name, 16) == 0)
+      break;
+  if(i == nclass){
+    if(nclass < NLOCKCLASS - 1)
+      classname[nclass++] = name;
+    else {
+      i = NLOCKCLASS - 1;
+      classname[i] = "(other)";
+      nclass = NLOCKCLASS;
+    }
+  }
+  release(&classlock);
+  return i;
+}
+
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
   lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->class = lockclass(name);
 }
 
 // Acquire the lock.
@@ -21,16 +67,29 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint64 spins = 0;
+  struct lockcount *lc;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
+#if TICKETLOCK
+  // Take a ticket, then wait until it is served. The atomic
+  // fetch-and-add turns into amoadd.w; the wait loop only
+  // reads lk->owner, so waiting CPUs share its cache line
+  // until the holder's release writes it.
+  uint ticket = __sync_fetch_and_add(&lk->next, 1);
+  while(__atomic_load_n(&lk->owner, __ATOMIC_RELAXED) != ticket)
+    spins++;
+#else
   // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
   //   a5 = 1
   //   s1 = &lk->locked
   //   amoswap.w.aq a5, a5, (s1)
   while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+    spins++;
+#endif
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +99,13 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+
+  lc = &lockcount[cpuid()][lk->class];
+  lc->nacquire++;
+  if(spins){
+    lc->ncontended++;
+    lc->nspin += spins;
+  }
 }
 
 // Release the lock.
@@ -59,6 +125,11 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
+#if TICKETLOCK
+  // Serve the next ticket. Only the holder writes lk->owner,
+  // so a plain increment stored in one instruction will do.
+  __atomic_store_n(&lk->owner, lk->owner + 1, __ATOMIC_RELAXED);
+#else
   // Release the lock, equivalent to lk->locked = 0.
   // This code doesn't use a C assignment, since the C standard
   // implies that an assignment might be implemented with
@@ -67,6 +138,7 @@ release(struct spinlock *lk)
   //   s1 = &lk->locked
   //   amoswap.w zero, zero, (s1)
   __sync_lock_release(&lk->locked);
+#endif
 
   pop_off();
 }
@@ -77,10 +149,44 @@ int
 holding(struct spinlock *lk)
 {
   int r;
+#if TICKETLOCK
+  r = (lk->owner != lk->next && lk->cpu == mycpu());
+#else
   r = (lk->locked && lk->cpu == mycpu());
+#endif
   return r;
 }
 
+// Sum the statistics of lock class i over all CPUs into *ls.
+// If ls is 0, reset the statistics of all classes instead.
+// Returns -1 if there is no class i.
+int
+lockstat(int i, struct lockstat *ls)
+{
+  if(ls == 0){
+    // racy against CPUs counting their own acquires,
+    // which at worst leaves a few counts behind.
+    memset(lockcount, 0, sizeof(lockcount));
+    return 0;
+  }
+
+  acquire(&classlock);
+  if(i < 0 || i >= nclass){
+    release(&classlock);
+    return -1;
+  }
+  safestrcpy(ls->name, classname[i], sizeof(ls->name));
+  release(&classlock);
+
+  ls->nacquire = ls->ncontended = ls->nspin = 0;
+  for(int c = 0; c < NCPU; c++){
+    ls->nacquire += lockcount[c][i].nacquire;
+    ls->ncontended += lockcount[c][i].ncontended;
+    ls->nspin += lockcount[c][i].nspin;
+  }
+  return 0;
+}
+
 // push_off/pop_off are like intr_off()/intr_on() except that they are matched:
 // it takes two pop_off()s to undo two push_off()s.  Also, if interrupts
 // are initially off, then push_off, pop_off leaves them off.
@@ -1,9 +1,16 @@
 // Mutual exclusion lock.
+//
+// With TICKETLOCK set in param.h, CPUs take a ticket and are
+// served in FIFO order, each spinning on a read of owner rather
+// than on an atomic swap. Otherwise the lock is a plain
+// test-and-set lock on locked.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint locked;       // Is the lock held? (test-and-set)
+  uint next;         // Next ticket to hand out (ticket)
+  uint owner;        // Ticket being served (ticket)
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+  int class;         // Statistics slot, shared by locks of the same name.
 };
-
@@ -0,0 +1,380 @@
+// Swapping of user pages to the swap area that mkfs
+// reserves at the end of the disk.
+//
+// The swap area is divided into page-sized slots. A swapped-out
+// page's PTE has PTE_V clear, PTE_S set, and the slot number where
+// the physical page number would be; its other flag bits are kept.
+//
+// The kswapd kernel thread evicts pages when free memory falls
+// below LOWATER, until HIWATER pages are free, or when a process
+// in kallocwait() finds no free page. It picks pages with the
+// clock algorithm, sweeping over all processes' user pages and
+// giving each page whose PTE_A bit is set a second chance.
+//
+// kswapd only changes the page table of a process that cannot be
+// using it: one that is SLEEPING, or RUNNABLE because it was
+// preempted in user space. It holds p->lock while it does so,
+// which keeps the process from running. A process pages its own
+// pages back in, from usertrap() or copyin()/copyout(); it never
+// holds a spinlock then, since swapin() sleeps.
+//
+// Lock order: p->lock, then swap.lock. swap.wlock is never
+// held with any other lock, except inside sleep().
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "fs.h"
+#include "buf.h"
+#include "kstat.h"
+#include "defs.h"
+
+#define SLOTBLKS  (PGSIZE / BSIZE)   // disk blocks per slot
+#define NSLOT     (SWAPSIZE / SLOTBLKS)
+
+#define LOWATER   64   // wake kswapd below this many free pages
+#define HIWATER   256  // kswapd evicts until this many are free
+#define SWAPBATCH 16   // pages evicted per page-table visit
+#define SCANMAX   512  // PTEs examined per page-table visit
+
+// slot states
+#define SLOT_FREE     0
+#define SLOT_USED     1  // holds a swapped-out page
+#define SLOT_WRITING  2  // kswapd is writing a page to it
+#define SLOT_DROPPED  3  // page was freed while being written
+
+extern struct proc proc[NPROC];
+
+struct {
+  struct spinlock lock;  // protects state[], next, nused, counters
+  uchar state[NSLOT];
+  int nslot;             // slots in this disk's swap area
+  int next;              // where to look for a free slot
+  int nused;
+  uint64 nout;           // pages swapped out
+  uint64 nin;            // pages swapped in
+
+  struct spinlock wlock; // protects demand, gen, ok
+  int demand;            // a process is waiting for memory
+  int gen;               // kswapd passes completed
+  int ok;                // last pass left some memory free
+
+  struct sleeplock iolock; // protects buf
+  struct buf buf[SLOTBLKS]; // for swap I/O, outside the buffer cache
+  uint dev;
+  uint start;            // first block of the swap area
+
+  int hand;              // clock hand: index into proc[]
+  uint64 handva;         // and user address within that process
+} swap;
+
+static void kswapd(void);
+
+// Called by fsinit() once the superblock has been read.
+void
+swapinit(int dev, struct superblock *sb)
+{
+  initlock(&swap.lock, "swap");
+  initlock(&swap.wlock, "swapwait");
+  initsleeplock(&swap.iolock, "swapio");
+  swap.dev = dev;
+  swap.start = sb->swapstart;
+  swap.nslot = sb->nswap / SLOTBLKS;
+  if(swap.nslot > NSLOT)
+    swap.nslot = NSLOT;
+  if(swap.nslot > 0)
+    kthreadcreate(kswapd, "kswapd");
+}
+
+// Find a free slot and mark it SLOT_WRITING.
+// Returns -1 if swap is full.
+static int
+slotalloc(void)
+{
+  int i, slot;
+
+  acquire(&swap.lock);
+  for(i = 0; i < swap.nslot; i++){
+    slot = (swap.next + i) % swap.nslot;
+    if(swap.state[slot] == SLOT_FREE){
+      swap.state[slot] = SLOT_WRITING;
+      swap.next = slot + 1;
+      swap.nused++;
+      release(&swap.lock);
+      return slot;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Free the swap slot that holds a swapped-out page,
+// e.g. because the page's process exited.
+void
+swapfree(uint64 slot)
+{
+  acquire(&swap.lock);
+  if(slot >= swap.nslot)
+    panic("swapfree");
+  if(swap.state[slot] == SLOT_WRITING){
+    // kswapd will free it when the write completes.
+    swap.state[slot] = SLOT_DROPPED;
+  } else if(swap.state[slot] == SLOT_USED){
+    swap.state[slot] = SLOT_FREE;
+    swap.nused--;
+  } else
+    panic("swapfree: state");
+  release(&swap.lock);
+}
+
+// Read or write a page from or to a swap slot. The slot's
+// blocks are consecutive, so they go to the disk together.
+static void
+swapio(uint64 slot, char *pa, int write)
+{
+  struct buf *b;
+  int i;
+
+  acquiresleep(&swap.iolock);
+  for(i = 0; i < SLOTBLKS; i++){
+    b = &swap.buf[i];
+    b->dev = swap.dev;
+    b->blockno = swap.start + slot*SLOTBLKS + i;
+    if(write)
+      memmove(b->data, pa + i*BSIZE, BSIZE);
+    iosubmit(b, write);
+  }
+  for(i = 0; i < SLOTBLKS; i++){
+    b = &swap.buf[i];
+    iowait(b);
+    if(!write)
+      memmove(pa + i*BSIZE, b->data, BSIZE);
+  }
+  releasesleep(&swap.iolock);
+}
+
+// Can kswapd change p's page table? p->lock must be held.
+static int
+evictable(struct proc *p)
+{
+  // a lone thread left after the others exited is fine.
+  if(p->pagetable == 0 || p->kfn || p->vforkwait || p->vforkparent || uspaceshared(p))
+    return 0;
+  return p->state == SLEEPING || (p->state == RUNNABLE && !p->kpreempted);
+}
+
+// Evict up to SWAPBATCH pages of the process under the clock
+// hand, advancing the hand. Returns the number of pages evicted,
+// or -1 if swap is full.
+static int
+evict(void)
+{
+  struct {
+    uint64 pa;
+    int slot;
+  } victim[SWAPBATCH];
+  struct proc *p;
+  pte_t *pte;
+  uint64 va;
+  int i, n, level, slot, scanned, full;
+
+  p = &proc[swap.hand];
+  n = full = 0;
+  acquire(&p->lock);
+  va = swap.handva;
+  if(evictable(p)){
+    for(scanned = 0; va < p->sz && scanned < SCANMAX; va += PGSIZE, scanned++){
+      pte = walkleaf(p->pagetable, va, &level);
+      if(pte == 0 || (*pte & PTE_U) == 0)
+        continue;
+      if(level > 0){
+        // only 4KB pages are swapped.
+        if(uvmdemote(p->pagetable, va) < 0){
+          va = SUPERPGROUNDDOWN(va) + SUPERPGSIZE - PGSIZE;
+          continue;
+        }
+        pte = walkleaf(p->pagetable, va, &level);
+      }
+      if(*pte & PTE_A){
+        // second chance. the TLB is flushed before p
+        // next runs in user space.
+        *pte &= ~PTE_A;
+        continue;
+      }
+      if((slot = slotalloc()) < 0){
+        full = 1;
+        break;
+      }
+      victim[n].pa = PTE2PA(*pte);
+      victim[n].slot = slot;
+      *pte = SLOT2PTE(slot) | (PTE_FLAGS(*pte) & ~(PTE_V|PTE_A|PTE_D)) | PTE_S;
+      if(++n == SWAPBATCH){
+        va += PGSIZE;
+        break;
+      }
+    }
+  }
+  if(!evictable(p) || va >= p->sz){
+    swap.hand = (swap.hand + 1) % NPROC;
+    va = 0;
+  }
+  swap.handva = va;
+  release(&p->lock);
+
+  for(i = 0; i < n; i++){
+    swapio(victim[i].slot, (char*)victim[i].pa, 1);
+    acquire(&swap.lock);
+    if(swap.state[victim[i].slot] == SLOT_DROPPED){
+      swap.state[victim[i].slot] = SLOT_FREE;
+      swap.nused--;
+    } else
+      swap.state[victim[i].slot] = SLOT_USED;
+    swap.nout++;
+    release(&swap.lock);
+    wakeup(&swap.state[victim[i].slot]);
+    kfree((void*)victim[i].pa);
+  }
+  return full ? -1 : n;
+}
+
+// Evict pages until target pages are free, swap is full, or
+// two full sweeps of the clock hand find nothing to evict.
+// Returns the number of pages evicted.
+static int
+reclaim(int target)
+{
+  int n, idle, freed;
+
+  freed = idle = 0;
+  while(nfreepages() < target && idle < 2*NPROC){
+    if((n = evict()) < 0)
+      break;
+    freed += n;
+    idle = n > 0 ? 0 : idle + (swap.handva == 0);
+  }
+  return freed;
+}
+
+static void
+kswapd(void)
+{
+  int freed;
+
+  for(;;){
+    acquire(&swap.wlock);
+    while(swap.demand == 0 && nfreepages() >= LOWATER)
+      sleep(&swap.demand, &swap.wlock);
+    swap.demand = 0;
+    release(&swap.wlock);
+
+    freed = reclaim(HIWATER);
+
+    acquire(&swap.wlock);
+    swap.gen++;
+    swap.ok = freed > 0 || nfreepages() > 0;
+    release(&swap.wlock);
+    wakeup(&swap.gen);
+  }
+}
+
+// Called on each clock tick: wake kswapd if memory is low.
+void
+swapkick(void)
+{
+  if(swap.nslot > 0 && nfreepages() < LOWATER)
+    wakeup(&swap.demand);
+}
+
+// Allocate a page like kalloc(), but if none is free, wait
+// for kswapd to swap some out. Returns 0 only if kswapd could
+// not free anything. Must not be called holding a spinlock.
+void*
+kallocwait(void)
+{
+  void *pa;
+  int gen, ok;
+
+  for(;;){
+    if((pa = kalloc()) != 0 || swap.nslot == 0)
+      return pa;
+
+    acquire(&swap.wlock);
+    gen = swap.gen;
+    swap.demand = 1;
+    wakeup(&swap.demand);
+    while(swap.gen == gen)
+      sleep(&swap.gen, &swap.wlock);
+    ok = swap.ok;
+    release(&swap.wlock);
+
+    if(!ok)
+      return kalloc();
+  }
+}
+
+// Bring the swapped-out page at va in pagetable back into
+// memory. Must be called by a process that uses pagetable.
+// Threads sharing pagetable may race to swap in the same page;
+// the loser finds it already in. Returns 0 on success, -1 if
+// va is not swapped out or there is no memory.
+int
+swapin(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 slot;
+  char *mem;
+
+  va = PGROUNDDOWN(va);
+  if(va >= MAXVA || (pte = walk(pagetable, va, 0)) == 0 || (*pte & PTE_S) == 0)
+    return -1;
+  if((mem = kallocwait()) == 0)
+    return -1;
+
+  // kswapd leaves swapped-out PTEs alone, so only
+  // another thread can have changed *pte meanwhile.
+  acquire(&swap.lock);
+  if((*pte & PTE_S) == 0){
+    release(&swap.lock);
+    kfree(mem);
+    return 0;
+  }
+  slot = PTE2SLOT(*pte);
+  while(swap.state[slot] == SLOT_WRITING)
+    sleep(&swap.state[slot], &swap.lock);
+  release(&swap.lock);
+
+  swapio(slot, mem, 0);
+  acquire(&swap.lock);
+  if((*pte & PTE_S) == 0 || PTE2SLOT(*pte) != slot){
+    release(&swap.lock);
+    kfree(mem);
+    return 0;
+  }
+  *pte = PA2PTE(mem) | (PTE_FLAGS(*pte) & ~PTE_S) | PTE_V | PTE_A;
+  swap.nin++;
+  release(&swap.lock);
+  swapfree(slot);
+  return 0;
+}
+
+// Fill in swap statistics. If ss is 0, reset the
+// event counters instead.
+void
+swapstat(struct swapstat *ss)
+{
+  acquire(&swap.lock);
+  if(ss == 0){
+    swap.nout = swap.nin = 0;
+    release(&swap.lock);
+    return;
+  }
+  ss->nslot = swap.nslot;
+  ss->nused = swap.nused;
+  ss->nout = swap.nout;
+  ss->nin = swap.nin;
+  release(&swap.lock);
+}
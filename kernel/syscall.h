@@ -20,3 +20,17 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_kstat  22
+#define SYS_ringsetup 23
+#define SYS_ringenter 24
+#define SYS_readv  25
+#define SYS_writev 26
+#define SYS_pread  27
+#define SYS_pwrite 28
+#define SYS_spawn  29
+#define SYS_vfork  30
+#define SYS_clone  31
+#define SYS_join   32
+#define SYS_futex  33
+#define SYS_shmat  34
+#define SYS_shmdt  35
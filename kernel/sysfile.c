@@ -15,6 +15,17 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
+#include "spawn.h"
+
+// Return the open file for file descriptor fd, or 0.
+struct file*
+fdfile(int fd)
+{
+  if(fd < 0 || fd >= NOFILE)
+    return 0;
+  return myproc()->ofile[fd];
+}
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -26,7 +37,7 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if((f = fdfile(fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -91,19 +102,91 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// Fetch the user's array of iovcnt iovecs at addr
+// (system call argument n) into iov.
+static int
+argiov(int n, int iovcnt, struct iovec *iov)
+{
+  uint64 addr;
+
+  if(argaddr(n, &addr) < 0 || iovcnt < 0 || iovcnt > MAXIOV)
+    return -1;
+  return copyin(myproc()->pagetable, (char*)iov, addr, iovcnt*sizeof(struct iovec));
+}
+
 uint64
-sys_close(void)
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[MAXIOV];
+  int iovcnt;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &iovcnt) < 0 || argiov(1, iovcnt, iov) < 0)
+    return -1;
+  return filereadv(f, iov, iovcnt);
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[MAXIOV];
+  int iovcnt;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &iovcnt) < 0 || argiov(1, iovcnt, iov) < 0)
+    return -1;
+  return filewritev(f, iov, iovcnt);
+}
+
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
+// Close file descriptor fd.
+int
+fdclose(int fd)
 {
-  int fd;
   struct file *f;
 
-  if(argfd(0, &fd, &f) < 0)
+  if((f = fdfile(fd)) == 0)
     return -1;
   myproc()->ofile[fd] = 0;
   fileclose(f);
   return 0;
 }
 
+uint64
+sys_close(void)
+{
+  int fd;
+
+  if(argint(0, &fd) < 0)
+    return -1;
+  return fdclose(fd);
+}
+
 uint64
 sys_fstat(void)
 {
@@ -283,17 +366,12 @@ create(char *path, short type, short major, short minor)
   return ip;
 }
 
-uint64
-sys_open(void)
+// Open path and return a new struct file for it.
+struct file*
+fileopen(char *path, int omode)
 {
-  char path[MAXPATH];
-  int fd, omode;
   struct file *f;
   struct inode *ip;
-  int n;
-
-  if((n = argstr(0, path, MAXPATH)) < 0 || argint(1, &omode) < 0)
-    return -1;
 
   begin_op();
 
@@ -301,33 +379,31 @@ sys_open(void)
     ip = create(path, T_FILE, 0, 0);
     if(ip == 0){
       end_op();
-      return -1;
+      return 0;
     }
   } else {
     if((ip = namei(path)) == 0){
       end_op();
-      return -1;
+      return 0;
     }
     ilock(ip);
     if(ip->type == T_DIR && omode != O_RDONLY){
       iunlockput(ip);
       end_op();
-      return -1;
+      return 0;
     }
   }
 
   if(ip->type == T_DEVICE && (ip->major < 0 || ip->major >= NDEV)){
     iunlockput(ip);
     end_op();
-    return -1;
+    return 0;
   }
 
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
-    if(f)
-      fileclose(f);
+  if((f = filealloc()) == 0){
     iunlockput(ip);
     end_op();
-    return -1;
+    return 0;
   }
 
   if(ip->type == T_DEVICE){
@@ -348,9 +424,37 @@ sys_open(void)
   iunlock(ip);
   end_op();
 
+  return f;
+}
+
+// Open path and return a new file descriptor for it.
+// Used by sys_open() and by the rings in ring.c.
+int
+fdopen(char *path, int omode)
+{
+  int fd;
+  struct file *f;
+
+  if((f = fileopen(path, omode)) == 0)
+    return -1;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
   return fd;
 }
 
+uint64
+sys_open(void)
+{
+  char path[MAXPATH];
+  int omode;
+
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, &omode) < 0)
+    return -1;
+  return fdopen(path, omode);
+}
+
 uint64
 sys_mkdir(void)
 {
@@ -412,19 +516,28 @@ sys_chdir(void)
   return 0;
 }
 
-uint64
-sys_exec(void)
+// Free the argument strings that fetchargv() fetched.
+static void
+freeargv(char **argv)
 {
-  char path[MAXPATH], *argv[MAXARG];
   int i;
-  uint64 uargv, uarg;
 
-  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  for(i = 0; i < MAXARG && argv[i] != 0; i++)
+    kfree(argv[i]);
+}
+
+// Fetch the user's null-terminated array of argument strings
+// at uargv into argv, in pages from kalloc(). On failure, frees
+// whatever it fetched and returns -1.
+static int
+fetchargv(uint64 uargv, char **argv)
+{
+  int i;
+  uint64 uarg;
+
+  memset(argv, 0, MAXARG*sizeof(char*));
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
+    if(i >= MAXARG){
       goto bad;
     }
     if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
@@ -440,18 +553,56 @@ sys_exec(void)
     if(fetchstr(uarg, argv[i], PGSIZE) < 0)
       goto bad;
   }
+  return 0;
+
+ bad:
+  freeargv(argv);
+  return -1;
+}
+
+uint64
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  uint64 uargv;
+
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
+    return -1;
+  }
+  if(fetchargv(uargv, argv) < 0)
+    return -1;
 
   int ret = exec(path, argv);
 
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-
+  freeargv(argv);
   return ret;
+}
 
- bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-  return -1;
+// Start a new process running path with argv, without copying
+// the caller's memory. nact actions in the user's array acts
+// set up the new process's file descriptors.
+uint64
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  struct spawnact acts[MAXSPAWNACT];
+  uint64 uargv, uacts;
+  int nact, ret;
+
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0 ||
+     argaddr(2, &uacts) < 0 || argint(3, &nact) < 0)
+    return -1;
+  if(nact < 0 || nact > MAXSPAWNACT)
+    return -1;
+  if(nact > 0 && copyin(myproc()->pagetable, (char*)acts, uacts, nact*sizeof(acts[0])) < 0)
+    return -1;
+  if(fetchargv(uargv, argv) < 0)
+    return -1;
+
+  ret = spawn(path, argv, acts, nact);
+
+  freeargv(argv);
+  return ret;
 }
 
 uint64
@@ -6,6 +6,8 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "kstat.h"
+#include "futex.h"
 
 uint64
 sys_exit(void)
@@ -29,6 +31,22 @@ sys_fork(void)
   return fork();
 }
 
+uint64
+sys_vfork(void)
+{
+  return vfork();
+}
+
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  if(argaddr(0, &fn) < 0 || argaddr(1, &arg) < 0 || argaddr(2, &stack) < 0)
+    return -1;
+  return clone(fn, arg, stack);
+}
+
 uint64
 sys_wait(void)
 {
@@ -38,16 +56,45 @@ sys_wait(void)
   return wait(p);
 }
 
+uint64
+sys_join(void)
+{
+  int tid;
+  uint64 p;
+
+  if(argint(0, &tid) < 0 || argaddr(1, &p) < 0)
+    return -1;
+  return join(tid, p);
+}
+
+uint64
+sys_futex(void)
+{
+  uint64 addr;
+  int op, val;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &op) < 0 || argint(2, &val) < 0)
+    return -1;
+  switch(op){
+  case FUTEX_WAIT:
+    return futexwait(addr, val);
+  case FUTEX_WAKE:
+    return futexwake(addr, val);
+  }
+  return -1;
+}
+
 uint64
 sys_sbrk(void)
 {
-  int addr;
+  uint64 addr;
   int n;
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
+  // read the old size in growproc(), since other
+  // threads may be growing the memory too.
+  if(growproc(n, &addr) < 0)
     return -1;
   return addr;
 }
@@ -95,3 +142,83 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// copy kernel statistics of the given kind to the user
+// buffer, at most n bytes; return the number of bytes copied.
+// a null buffer resets the statistics' event counters.
+// KSTAT_LOCK copies an array of whole struct lockstat.
+uint64
+sys_kstat(void)
+{
+  int kind, n;
+  uint64 addr;
+  struct memstat ms;
+  struct swapstat ss;
+  struct lockstat ls;
+  struct logstat lgs;
+  struct diskstat ds;
+  char *src;
+  int i, size;
+
+  if(argint(0, &kind) < 0 || argaddr(1, &addr) < 0 || argint(2, &n) < 0)
+    return -1;
+  if(n < 0)
+    return -1;
+
+  switch(kind){
+  case KSTAT_MEM:
+    if(addr == 0){
+      kallocstat(0);
+      return 0;
+    }
+    kallocstat(&ms);
+    src = (char*)&ms;
+    size = sizeof(ms);
+    break;
+  case KSTAT_SWAP:
+    if(addr == 0){
+      swapstat(0);
+      return 0;
+    }
+    swapstat(&ss);
+    src = (char*)&ss;
+    size = sizeof(ss);
+    break;
+  case KSTAT_LOCK:
+    if(addr == 0){
+      lockstat(0, 0);
+      return 0;
+    }
+    for(i = 0; (i+1)*sizeof(ls) <= n && lockstat(i, &ls) == 0; i++){
+      if(copyout(myproc()->pagetable, addr + i*sizeof(ls), (char*)&ls, sizeof(ls)) < 0)
+        return -1;
+    }
+    return i*sizeof(ls);
+  case KSTAT_LOG:
+    if(addr == 0){
+      logstat(0);
+      return 0;
+    }
+    logstat(&lgs);
+    src = (char*)&lgs;
+    size = sizeof(lgs);
+    break;
+  case KSTAT_DISK:
+    if(addr == 0){
+      iostat(0);
+      return 0;
+    }
+    iostat(&ds);
+    src = (char*)&ds;
+    size = sizeof(ds);
+    break;
+  default:
+    return -1;
+  }
+
+  if(n > size)
+    n = size;
+  if(copyout(myproc()->pagetable, addr, src, n) < 0)
+    return -1;
+  return n;
+}
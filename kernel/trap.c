@@ -67,6 +67,9 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if((r_scause() == 12 || r_scause() == 13 || r_scause() == 15) &&
+            swapin(p->pagetable, r_stval()) == 0){
+    // page fault on a swapped-out page, now swapped back in.
   } else {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
@@ -106,6 +109,12 @@ usertrapret(void)
   p->trapframe->kernel_trap = (uint64)usertrap;
   p->trapframe->kernel_hartid = r_tp();         // hartid for cpuid()
 
+  // refresh the values user code reads from the USYSCALL page.
+  // a timer interrupt brings the process through here on every
+  // tick, so ticks is never more than a tick out of date.
+  p->usyscall->ticks = ticks;
+  p->usyscall->time = r_time();
+
   // set up the registers that trampoline.S's sret will use
   // to get to user space.
   
@@ -125,7 +134,7 @@ usertrapret(void)
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 fn = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64,uint64))fn)(TRAPFRAME, satp);
+  ((void (*)(uint64,uint64))fn)(p->trapva, satp);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -150,8 +159,13 @@ kerneltrap()
   }
 
   // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
+  // kswapd must leave the page table of a process preempted
+  // here alone, since it may be in the middle of using it.
+  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING){
+    myproc()->kpreempted = 1;
     yield();
+    myproc()->kpreempted = 0;
+  }
 
   // the yield() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
@@ -166,6 +180,7 @@ clockintr()
   ticks++;
   wakeup(&ticks);
   release(&tickslock);
+  swapkick();
 }
 
 // check if it's an external interrupt or software interrupt,
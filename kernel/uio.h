@@ -0,0 +1,5 @@
+// A user buffer for readv() and writev().
+struct iovec {
+  void *iov_base;
+  uint iov_len;
+};
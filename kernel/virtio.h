@@ -44,8 +44,8 @@
 #define VIRTIO_RING_F_EVENT_IDX     29
 
 // this many virtio descriptors.
-// must be a power of two.
-#define NUM 8
+// must be a power of two, and at least MAXSEG+2.
+#define NUM 32
 
 struct VRingDesc {
   uint64 addr;
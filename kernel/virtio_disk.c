@@ -20,6 +20,14 @@
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
 
+// the first descriptor of each request points here.
+// qemu's virtio-blk.c reads it.
+struct virtio_blk_outhdr {
+  uint32 type;
+  uint32 reserved;
+  uint64 sector;
+};
+
 static struct disk {
  // memory for virtio descriptors &c for queue 0.
  // this is a global instead of allocated because it must
@@ -38,7 +46,9 @@ static struct disk {
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    struct virtio_blk_outhdr hdr;
+    struct buf *b[MAXSEG];
+    int n;
     char status;
   } info[NUM];
   
@@ -135,7 +145,6 @@ free_desc(int i)
     panic("virtio_disk_intr 2");
   disk.desc[i].addr = 0;
   disk.free[i] = 1;
-  wakeup(&disk.free[0]);
 }
 
 // free a chain of descriptors.
@@ -143,18 +152,21 @@ static void
 free_chain(int i)
 {
   while(1){
+    int flags = disk.desc[i].flags;
+    int next = disk.desc[i].next;
     free_desc(i);
-    if(disk.desc[i].flags & VRING_DESC_F_NEXT)
-      i = disk.desc[i].next;
+    if(flags & VRING_DESC_F_NEXT)
+      i = next;
     else
       break;
   }
 }
 
+// allocate n descriptors, all or none.
 static int
-alloc3_desc(int *idx)
+allocn_desc(int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
+  for(int i = 0; i < n; i++){
     idx[i] = alloc_desc();
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
@@ -165,106 +177,104 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// Start one request for the n buffers in b[], which hold
+// consecutive blocks. Does not wait; virtio_disk_intr()
+// passes them to iodone() when the disk is finished.
+// Returns -1 if there are not enough free descriptors.
+int
+virtio_disk_start(struct buf **b, int n, int write)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  int idx[MAXSEG+2];
+  int i, d;
 
-  acquire(&disk.vdisk_lock);
+  if(n < 1 || n > MAXSEG)
+    panic("virtio_disk_start");
 
-  // the spec says that legacy block operations use three
-  // descriptors: one for type/reserved/sector, one for
-  // the data, one for a 1-byte status result.
+  acquire(&disk.vdisk_lock);
 
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
+  // the spec says that legacy block operations use a
+  // descriptor for type/reserved/sector, one for each
+  // segment of data, and one for a 1-byte status result.
+  if(allocn_desc(idx, n+2) < 0){
+    release(&disk.vdisk_lock);
+    return -1;
   }
-  
-  // format the three descriptors.
-  // qemu's virtio-blk.c reads them.
-
-  struct virtio_blk_outhdr {
-    uint32 type;
-    uint32 reserved;
-    uint64 sector;
-  } buf0;
 
+  d = idx[0];
   if(write)
-    buf0.type = VIRTIO_BLK_T_OUT; // write the disk
-  else
-    buf0.type = VIRTIO_BLK_T_IN; // read the disk
-  buf0.reserved = 0;
-  buf0.sector = sector;
-
-  // buf0 is on a kernel stack, which is not direct mapped,
-  // thus the call to kvmpa().
-  disk.desc[idx[0]].addr = (uint64) kvmpa((uint64) &buf0);
-  disk.desc[idx[0]].len = sizeof(buf0);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
-
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
+    disk.info[d].hdr.type = VIRTIO_BLK_T_OUT; // write the disk
   else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
-
-  disk.info[idx[0]].status = 0;
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+    disk.info[d].hdr.type = VIRTIO_BLK_T_IN; // read the disk
+  disk.info[d].hdr.reserved = 0;
+  disk.info[d].hdr.sector = b[0]->blockno * (BSIZE / 512);
+
+  disk.desc[d].addr = (uint64) &disk.info[d].hdr;
+  disk.desc[d].len = sizeof(disk.info[d].hdr);
+  disk.desc[d].flags = VRING_DESC_F_NEXT;
+  disk.desc[d].next = idx[1];
+
+  for(i = 0; i < n; i++){
+    disk.desc[idx[i+1]].addr = (uint64) b[i]->data;
+    disk.desc[idx[i+1]].len = BSIZE;
+    if(write)
+      disk.desc[idx[i+1]].flags = 0; // device reads b->data
+    else
+      disk.desc[idx[i+1]].flags = VRING_DESC_F_WRITE; // device writes b->data
+    disk.desc[idx[i+1]].flags |= VRING_DESC_F_NEXT;
+    disk.desc[idx[i+1]].next = idx[i+2];
+    disk.info[d].b[i] = b[i];
+  }
+  disk.info[d].n = n;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  disk.info[d].status = 0xff; // device writes 0 on success
+  disk.desc[idx[n+1]].addr = (uint64) &disk.info[d].status;
+  disk.desc[idx[n+1]].len = 1;
+  disk.desc[idx[n+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[idx[n+1]].next = 0;
 
   // avail[0] is flags
   // avail[1] tells the device how far to look in avail[2...].
   // avail[2...] are desc[] indices the device should process.
   // we only tell device the first index in our chain of descriptors.
-  disk.avail[2 + (disk.avail[1] % NUM)] = idx[0];
+  disk.avail[2 + (disk.avail[1] % NUM)] = d;
   __sync_synchronize();
   disk.avail[1] = disk.avail[1] + 1;
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
-  // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
-  }
-
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
-
   release(&disk.vdisk_lock);
+  return 0;
 }
 
 void
 virtio_disk_intr()
 {
+  struct buf *b[MAXSEG];
+  int id, n;
+
   acquire(&disk.vdisk_lock);
+  // the device won't raise another interrupt until we
+  // tell it we've seen this one; it may finish more
+  // requests while we look, which the loop also sees.
+  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
 
   while((disk.used_idx % NUM) != (disk.used->id % NUM)){
-    int id = disk.used->elems[disk.used_idx].id;
+    __sync_synchronize();
+    id = disk.used->elems[disk.used_idx].id;
 
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
-    
-    disk.info[id].b->disk = 0;   // disk is done with buf
-    wakeup(disk.info[id].b);
 
+    n = disk.info[id].n;
+    memmove(b, disk.info[id].b, n * sizeof(b[0]));
+    free_chain(id);
     disk.used_idx = (disk.used_idx + 1) % NUM;
+
+    // iodone() may start more requests, which needs this lock.
+    release(&disk.vdisk_lock);
+    iodone(b, n);
+    acquire(&disk.vdisk_lock);
   }
-  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
 
   release(&disk.vdisk_lock);
 }
@@ -40,6 +40,7 @@ kvminit()
   kvmmap(KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
   // map kernel data and the physical RAM we'll make use of.
+  // mappages() uses megapages for the 2MB-aligned part.
   kvmmap((uint64)etext, (uint64)etext, PHYSTOP-(uint64)etext, PTE_R | PTE_W);
 
   // map the trampoline for trap entry/exit to
@@ -68,15 +69,21 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
-pte_t *
-walk(pagetable_t pagetable, uint64 va, int alloc)
+//
+// A leaf PTE in a level-1 page table maps a 2MB megapage.
+// walkto() stops at the PTE for va in the level-target page
+// table, or earlier if it finds a megapage leaf on the way.
+static pte_t *
+walkto(pagetable_t pagetable, uint64 va, int alloc, int target)
 {
   if(va >= MAXVA)
     panic("walk");
 
-  for(int level = 2; level > 0; level--) {
+  for(int level = 2; level > target; level--) {
     pte_t *pte = &pagetable[PX(level, va)];
     if(*pte & PTE_V) {
+      if(PTE_LEAF(*pte))
+        return pte;
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
       if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
@@ -85,29 +92,55 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
-  return &pagetable[PX(0, va)];
+  return &pagetable[PX(target, va)];
+}
+
+pte_t *
+walk(pagetable_t pagetable, uint64 va, int alloc)
+{
+  return walkto(pagetable, va, alloc, 0);
 }
 
-// Look up a virtual address, return the physical address,
-// or 0 if not mapped.
+// Return the leaf PTE that maps va, or 0 if there is none,
+// and set *level to the level of the page table it is in:
+// 0 for a 4KB page, 1 for a megapage.
+pte_t *
+walkleaf(pagetable_t pagetable, uint64 va, int *level)
+{
+  pte_t *pte;
+
+  for(*level = 2; *level >= 0; (*level)--){
+    pte = &pagetable[PX(*level, va)];
+    if((*pte & PTE_V) == 0)
+      return 0;
+    if(PTE_LEAF(*pte))
+      return pte;
+    pagetable = (pagetable_t)PTE2PA(*pte);
+  }
+  return 0;
+}
+
+// Look up a virtual address, return the physical address
+// of the page containing it, or 0 if not mapped.
 // Can only be used to look up user pages.
 uint64
 walkaddr(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
   uint64 pa;
+  int level;
 
   if(va >= MAXVA)
     return 0;
 
-  pte = walk(pagetable, va, 0);
+  pte = walkleaf(pagetable, va, &level);
   if(pte == 0)
     return 0;
-  if((*pte & PTE_V) == 0)
-    return 0;
   if((*pte & PTE_U) == 0)
     return 0;
   pa = PTE2PA(*pte);
+  if(level > 0)
+    pa += PGROUNDDOWN(va) & ((1L << PXSHIFT(level)) - 1);
   return pa;
 }
 
@@ -121,74 +154,124 @@ kvmmap(uint64 va, uint64 pa, uint64 sz, int perm)
     panic("kvmmap");
 }
 
-// translate a kernel virtual address to
-// a physical address. only needed for
-// addresses on the stack.
-// assumes va is page aligned.
-uint64
-kvmpa(uint64 va)
+// If the level-1 PTE *pte points to a level-0 page table with
+// nothing mapped in it, as shrinking the heap can leave behind,
+// free the table so that a megapage can take its place.
+// Returns 0 if it did, -1 if the table is in use.
+static int
+freeempty(pte_t *pte)
 {
-  uint64 off = va % PGSIZE;
-  pte_t *pte;
-  uint64 pa;
-  
-  pte = walk(kernel_pagetable, va, 0);
-  if(pte == 0)
-    panic("kvmpa");
-  if((*pte & PTE_V) == 0)
-    panic("kvmpa");
-  pa = PTE2PA(*pte);
-  return pa+off;
+  pagetable_t pt = (pagetable_t)PTE2PA(*pte);
+
+  for(int i = 0; i < 512; i++)
+    if(pt[i] != 0)
+      return -1;
+  *pte = 0;
+  kfree((void*)pt);
+  return 0;
 }
 
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
-// be page-aligned. Returns 0 on success, -1 if walk() couldn't
+// be page-aligned. Wherever va and pa are both 2MB-aligned and
+// at least 2MB remain, a single megapage PTE is used.
+// Returns 0 on success, -1 if walk() couldn't
 // allocate a needed page-table page.
 int
 mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 {
-  uint64 a, last;
+  uint64 a, last, n;
   pte_t *pte;
 
   a = PGROUNDDOWN(va);
   last = PGROUNDDOWN(va + size - 1);
   for(;;){
-    if((pte = walk(pagetable, a, 1)) == 0)
+    if(a % SUPERPGSIZE == 0 && pa % SUPERPGSIZE == 0 &&
+       last - a >= SUPERPGSIZE - PGSIZE){
+      pte = walkto(pagetable, a, 1, 1);
+      n = SUPERPGSIZE;
+      if(pte && (*pte & PTE_V) && !PTE_LEAF(*pte) && freeempty(pte) < 0){
+        // part of the 2MB is mapped already: use 4KB pages.
+        pte = walk(pagetable, a, 1);
+        n = PGSIZE;
+      }
+    } else {
+      pte = walk(pagetable, a, 1);
+      n = PGSIZE;
+    }
+    if(pte == 0)
       return -1;
     if(*pte & PTE_V)
       panic("remap");
     *pte = PA2PTE(pa) | perm | PTE_V;
-    if(a == last)
+    if(a + n > last)
       break;
-    a += PGSIZE;
-    pa += PGSIZE;
+    a += n;
+    pa += n;
   }
   return 0;
 }
 
+// If va lies inside a megapage, replace the megapage with
+// a level-0 page table mapping the same memory as 512 4KB
+// pages, so that part of it can be unmapped or changed.
+// Returns 0 on success, -1 if out of memory.
+int
+uvmdemote(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  pagetable_t pt;
+  uint64 pa;
+  int level, flags;
+
+  if((pte = walkleaf(pagetable, va, &level)) == 0 || level == 0)
+    return 0;
+  if(level != 1)
+    panic("uvmdemote");
+  if((pt = (pagetable_t)kalloc()) == 0)
+    return -1;
+  pa = PTE2PA(*pte);
+  flags = PTE_FLAGS(*pte);
+  for(int i = 0; i < 512; i++)
+    pt[i] = PA2PTE(pa + i*PGSIZE) | flags;
+  *pte = PA2PTE(pt) | PTE_V;
+  sfence_vma();
+  return 0;
+}
+
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. The mappings must exist, and a megapage must
+// be removed as a whole; see uvmdemote(). A mapping may be
+// swapped out, in which case its swap slot is freed.
 // Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
-  uint64 a;
+  uint64 a, n;
   pte_t *pte;
+  int level;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
-  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-    if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
-    if(PTE_FLAGS(*pte) == PTE_V)
-      panic("uvmunmap: not a leaf");
+  for(a = va; a < va + npages*PGSIZE; a += n){
+    n = PGSIZE;
+    if((pte = walkleaf(pagetable, a, &level)) == 0){
+      if((pte = walk(pagetable, a, 0)) == 0 || (*pte & PTE_S) == 0)
+        panic("uvmunmap: not mapped");
+      if(do_free)
+        swapfree(PTE2SLOT(*pte));
+      *pte = 0;
+      continue;
+    }
+    if(level > 0){
+      n = SUPERPGSIZE;
+      if(level != 1 || a % SUPERPGSIZE != 0 || a + n > va + npages*PGSIZE)
+        panic("uvmunmap: partial megapage");
+    }
     if(do_free){
       uint64 pa = PTE2PA(*pte);
-      kfree((void*)pa);
+      kfreepages((void*)pa, n == PGSIZE ? 0 : SUPERORDER);
     }
     *pte = 0;
   }
@@ -225,25 +308,38 @@ uvminit(pagetable_t pagetable, uchar *src, uint sz)
 
 // Allocate PTEs and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
+// Whole 2MB-aligned chunks of the new range are mapped as megapages
+// if contiguous physical memory is available.
 uint64
 uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
   char *mem;
-  uint64 a;
+  uint64 a, n;
+  int order;
 
   if(newsz < oldsz)
     return oldsz;
 
   oldsz = PGROUNDUP(oldsz);
-  for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+  for(a = oldsz; a < newsz; a += n){
+    mem = 0;
+    if(a % SUPERPGSIZE == 0 && newsz - a >= SUPERPGSIZE)
+      mem = kallocpages(SUPERORDER);
+    if(mem){
+      n = SUPERPGSIZE;
+      order = SUPERORDER;
+    } else {
+      mem = kallocwait();
+      n = PGSIZE;
+      order = 0;
+    }
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
-    if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
-      kfree(mem);
+    memset(mem, 0, n);
+    if(mappages(pagetable, a, n, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
+      kfreepages(mem, order);
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
@@ -254,7 +350,8 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
-// process size.  Returns the new process size.
+// process size.  Returns the new process size, or oldsz if a
+// megapage straddling newsz could not be split.
 uint64
 uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
@@ -262,6 +359,9 @@ uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
     return oldsz;
 
   if(PGROUNDUP(newsz) < PGROUNDUP(oldsz)){
+    if(PGROUNDUP(newsz) % SUPERPGSIZE != 0 &&
+       uvmdemote(pagetable, PGROUNDUP(newsz)) < 0)
+      return oldsz;
     int npages = (PGROUNDUP(oldsz) - PGROUNDUP(newsz)) / PGSIZE;
     uvmunmap(pagetable, PGROUNDUP(newsz), npages, 1);
   }
@@ -302,29 +402,53 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 // Given a parent process's page table, copy
 // its memory into a child's page table.
 // Copies both the page table and the
-// physical memory.
+// physical memory. Must be called by the
+// process that owns old, since it swaps
+// pages of old back in and may sleep.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
   pte_t *pte;
-  uint64 pa, i;
+  uint64 pa, i, n;
   uint flags;
   char *mem;
+  int level, order;
+
+  for(i = 0; i < sz; i += n){
+    n = 0;
+    if((pte = walkleaf(old, i, &level)) == 0){
+      if(swapin(old, i) < 0)
+        goto err;
+      continue;
+    }
+    mem = 0;
+    if(level > 0 && i % SUPERPGSIZE == 0)
+      mem = kallocpages(SUPERORDER);
+    if(mem){
+      order = SUPERORDER;
+    } else {
+      if((mem = kallocwait()) == 0)
+        goto err;
+      order = 0;
+    }
 
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+    // kallocwait() may have slept, and kswapd may
+    // have split or swapped out the page meanwhile.
+    if((pte = walkleaf(old, i, &level)) == 0 || (order > 0 && level == 0)){
+      kfreepages(mem, order);
+      continue;
+    }
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
+    n = PGSIZE << order;
+    // copy a megapage a page at a time if no 2MB block is free.
+    if(level > 0 && order == 0)
+      pa += i % SUPERPGSIZE;
+    memmove(mem, (char*)pa, n);
+    if(mappages(new, i, n, (uint64)mem, flags) != 0){
+      kfreepages(mem, order);
       goto err;
     }
   }
@@ -348,6 +472,19 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// Like walkaddr(), but if the page has been swapped out,
+// swap it back in. Must be called by a process that uses
+// pagetable, without holding any spinlocks.
+uint64
+walkaddrin(pagetable_t pagetable, uint64 va)
+{
+  uint64 pa;
+
+  if((pa = walkaddr(pagetable, va)) == 0 && swapin(pagetable, va) == 0)
+    pa = walkaddr(pagetable, va);
+  return pa;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
@@ -358,7 +495,7 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = walkaddrin(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (dstva - va0);
@@ -383,7 +520,7 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = walkaddrin(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -410,7 +547,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = walkaddrin(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -18,11 +18,11 @@
 #define NINODES 200
 
 // Disk layout:
-// [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
+// [ boot block | sb block | log | inode blocks | free bit map | data blocks | swap ]
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog = LOGSIZE + 1;  // header block and LOGSIZE data blocks
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -67,7 +67,7 @@ xint(uint x)
 int
 main(int argc, char *argv[])
 {
-  int i, cc, fd;
+  int i, cc, fd, first;
   uint rootino, inum, off;
   struct dirent de;
   char buf[BSIZE];
@@ -77,10 +77,21 @@ main(int argc, char *argv[])
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs fs.img [-l logblocks] files...\n");
     exit(1);
   }
 
+  first = 2;
+  if(argc >= 4 && strcmp(argv[2], "-l") == 0){
+    nlog = atoi(argv[3]);
+    if(nlog < MAXOPBLOCKS + 1 || nlog > LOGSIZE + 1){
+      fprintf(stderr, "mkfs: log must be %d to %d blocks\n",
+              MAXOPBLOCKS + 1, LOGSIZE + 1);
+      exit(1);
+    }
+    first = 4;
+  }
+
   assert((BSIZE % sizeof(struct dinode)) == 0);
   assert((BSIZE % sizeof(struct dirent)) == 0);
 
@@ -102,15 +113,23 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.swapstart = xint(FSSIZE);
+  sb.nswap = xint(SWAPSIZE);
 
-  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d swap %d\n",
+         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE, SWAPSIZE);
 
   freeblock = nmeta;     // the first free block that we can allocate
 
   for(i = 0; i < FSSIZE; i++)
     wsect(i, zeroes);
 
+  // the swap area needs no initialization; leave it sparse.
+  if(ftruncate(fsfd, (off_t)(FSSIZE + SWAPSIZE) * BSIZE) < 0){
+    perror("ftruncate");
+    exit(1);
+  }
+
   memset(buf, 0, sizeof(buf));
   memmove(buf, &sb, sizeof(sb));
   wsect(1, buf);
@@ -128,7 +147,7 @@ main(int argc, char *argv[])
   strcpy(de.name, "..");
   iappend(rootino, &de, sizeof(de));
 
-  for(i = 2; i < argc; i++){
+  for(i = first; i < argc; i++){
     // get rid of "user/"
     char *shortname;
     if(strncmp(argv[i], "user/", 5) == 0)
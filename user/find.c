@@ -2,6 +2,21 @@
 #include "kernel/stat.h"
 #include "kernel/types.h"
 #include "kernel/fs.h"
+#include "kernel/param.h"
+
+#define MAXWORKERS 8
+
+// A message between find and its workers. It is PIPEBUF bytes,
+// so workers' messages on the shared result pipe never mix.
+struct msg {
+    char type;       // one of the MSG_ kinds below
+    char worker;     // sender, on the result pipe
+    char path[PIPEBUF - 2];
+};
+
+#define MSG_DIR   'D' // a directory to search, or one that was found
+#define MSG_MATCH 'M' // a matching file
+#define MSG_DONE  'E' // the worker finished its directory
 
 /**
  * Give a filepath, find the file name.
@@ -101,12 +116,208 @@ find(char *path, char *filename) {
     }
 }
 
+/**
+ * Read a whole message from a pipe.
+ * @return 0 on success, -1 at end of file.
+ */
+static int
+readmsg(int fd, struct msg *m) {
+    int n, r;
+
+    for (n = 0; n < sizeof(*m); n += r) {
+        if ((r = read(fd, (char *) m + n, sizeof(*m) - n)) <= 0)
+            return -1;
+    }
+    return 0;
+}
+
+static void
+sendmsg(int fd, int type, int worker, char *path) {
+    struct msg m;
+
+    m.type = type;
+    m.worker = worker;
+    strcpy(m.path, path);
+    if (write(fd, &m, sizeof(m)) != sizeof(m)) {
+        fprintf(2, "find: pipe write failed\n");
+        exit(1);
+    }
+}
+
+/**
+ * A worker: search one directory at a time, as find() does, but
+ * report matches and subdirectories on the result pipe instead of
+ * printing or descending into them.
+ * @param w The worker's number.
+ * @param in The pipe it reads directories to search from.
+ * @param out The result pipe shared by all workers.
+ */
+static void
+worker(int w, int in, int out, char *filename) {
+    struct msg m;
+    struct dirent de;
+    struct stat st;
+    char buf[sizeof(m.path)], *p;
+    int fd;
+
+    while (readmsg(in, &m) == 0) {
+        if ((fd = open(m.path, 0)) < 0) {
+            fprintf(2, "find: cannot open %s\n", m.path);
+            sendmsg(out, MSG_DONE, w, "");
+            continue;
+        }
+        strcpy(buf, m.path);
+        p = buf + strlen(buf);
+        *p++ = '/';
+        while (read(fd, &de, sizeof(de)) == sizeof(de)) {
+            if (de.inum == 0 || strcmp(de.name, ".") == 0 || strcmp(de.name, "..") == 0)
+                continue;
+            if (p + DIRSIZ + 1 > buf + sizeof(buf)) {
+                fprintf(2, "find: path too long\n");
+                break;
+            }
+            memmove(p, de.name, DIRSIZ);
+            p[DIRSIZ] = 0;
+            if (stat(buf, &st) < 0) {
+                fprintf(2, "find: cannot stat %s\n", buf);
+                continue;
+            }
+            if (st.type == T_FILE && strcmp(de.name, filename) == 0)
+                sendmsg(out, MSG_MATCH, w, buf);
+            else if (st.type == T_DIR)
+                sendmsg(out, MSG_DIR, w, buf);
+        }
+        close(fd);
+        sendmsg(out, MSG_DONE, w, "");
+    }
+    exit(0);
+}
+
+// Directories waiting for an idle worker.
+struct dirq {
+    struct dirq *next;
+    char path[PIPEBUF - 2];
+};
+
+/**
+ * Search path with nworker worker processes. find hands each idle
+ * worker one directory at a time over its own pipe, queues the
+ * subdirectories the workers find, and prints their matches.
+ */
+void
+pfind(char *path, char *filename, int nworker) {
+    int req[MAXWORKERS], res[2], fds[2];
+    int idle[MAXWORKERS], nidle, busy, w;
+    struct dirq *head, *tail, *d;
+    struct msg m;
+    struct stat st;
+    char *root;
+
+    if (strlen(path) >= sizeof(m.path)) {
+        fprintf(2, "find: path too long\n");
+        return;
+    }
+    // as in find(), before any worker reads it as a directory.
+    if (stat(path, &st) < 0) {
+        fprintf(2, "find: cannot stat %s\n", path);
+        return;
+    }
+    if (st.type != T_DIR) {
+        fprintf(2, "find: please specify a valid directory to search\n");
+        return;
+    }
+    if (pipe(res) < 0) {
+        fprintf(2, "find: pipe failed\n");
+        exit(1);
+    }
+    for (w = 0; w < nworker; w++) {
+        if (pipe(fds) < 0) {
+            fprintf(2, "find: pipe failed\n");
+            exit(1);
+        }
+        int pid = fork();
+        if (pid < 0) {
+            fprintf(2, "find: fork failed\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            close(fds[1]);
+            close(res[0]);
+            for (int i = 0; i < w; i++)
+                close(req[i]);
+            worker(w, fds[0], res[1], filename);
+        }
+        close(fds[0]);
+        req[w] = fds[1];
+        idle[w] = w;
+    }
+    close(res[1]);
+
+    nidle = nworker;
+    busy = 0;
+    head = tail = 0;
+    root = path;
+    for (;;) {
+        // give queued directories to idle workers.
+        while (nidle > 0 && (root || head)) {
+            w = idle[--nidle];
+            if (root) {
+                sendmsg(req[w], MSG_DIR, 0, root);
+                root = 0;
+            } else {
+                d = head;
+                head = d->next;
+                sendmsg(req[w], MSG_DIR, 0, d->path);
+                free(d);
+            }
+            busy++;
+        }
+        if (busy == 0)
+            break;
+        if (readmsg(res[0], &m) < 0) {
+            fprintf(2, "find: worker died\n");
+            exit(1);
+        }
+        if (m.type == MSG_MATCH) {
+            printf("%s\n", m.path);
+        } else if (m.type == MSG_DIR) {
+            d = malloc(sizeof(*d));
+            strcpy(d->path, m.path);
+            d->next = 0;
+            if (head)
+                tail->next = d;
+            else
+                head = d;
+            tail = d;
+        } else if (m.type == MSG_DONE) {
+            idle[nidle++] = m.worker;
+            busy--;
+        }
+    }
+
+    for (w = 0; w < nworker; w++)
+        close(req[w]);
+    close(res[0]);
+    for (w = 0; w < nworker; w++)
+        wait(0);
+}
+
 int
 main(int argc, char *argv[]) {
-    if (argc != 3) {
-        fprintf(2, "Usage: find directory filename\n");
+    int nworker = 0;
+
+    if (argc == 5 && strcmp(argv[1], "-j") == 0) {
+        nworker = atoi(argv[2]);
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc != 3 || nworker < 0 || nworker > MAXWORKERS) {
+        fprintf(2, "Usage: find [-j workers] directory filename\n");
         exit(1);
     }
-    find(argv[1], argv[2]);
+    if (nworker > 0)
+        pfind(argv[1], argv[2], nworker);
+    else
+        find(argv[1], argv[2]);
     exit(0);
 }
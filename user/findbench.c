@@ -0,0 +1,144 @@
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define FANOUT 3      // subdirectories per directory
+#define DEPTH 3       // levels of subdirectories below the root
+#define ROUNDS 5      // walks timed per setting
+#define ROOT "fbtree"
+#define OUT "fbtree.out"
+
+static int ndirs;
+
+/**
+ * Build a tree below path: each directory holds a file named
+ * "target" and, above the last level, FANOUT subdirectories.
+ */
+static void build(char *path, int depth) {
+    char buf[128];
+    int fd;
+
+    if (mkdir(path) < 0) {
+        fprintf(2, "findbench: mkdir %s failed\n", path);
+        exit(1);
+    }
+    ndirs++;
+    strcpy(buf, path);
+    strcpy(buf + strlen(buf), "/target");
+    if ((fd = open(buf, O_CREATE | O_WRONLY)) < 0) {
+        fprintf(2, "findbench: create %s failed\n", buf);
+        exit(1);
+    }
+    close(fd);
+    if (depth == DEPTH)
+        return;
+    for (int i = 0; i < FANOUT; i++) {
+        strcpy(buf, path);
+        char *p = buf + strlen(buf);
+        *p++ = '/';
+        *p++ = 'd';
+        *p++ = '0' + i;
+        *p = 0;
+        build(buf, depth + 1);
+    }
+}
+
+/**
+ * Remove the tree that build() made.
+ */
+static void destroy(char *path, int depth) {
+    char buf[128];
+
+    if (depth < DEPTH) {
+        for (int i = 0; i < FANOUT; i++) {
+            strcpy(buf, path);
+            char *p = buf + strlen(buf);
+            *p++ = '/';
+            *p++ = 'd';
+            *p++ = '0' + i;
+            *p = 0;
+            destroy(buf, depth + 1);
+        }
+    }
+    strcpy(buf, path);
+    strcpy(buf + strlen(buf), "/target");
+    unlink(buf);
+    unlink(path);
+}
+
+/**
+ * Run find over the tree with nworker workers, 0 meaning the
+ * serial walk, sending its output to OUT.
+ * @return The number of lines find printed.
+ */
+static int walk(int nworker) {
+    char nbuf[4], buf[128];
+    char *argv[6];
+    int argc = 0, n, lines;
+
+    argv[argc++] = "find";
+    if (nworker > 0) {
+        nbuf[0] = '0' + nworker;
+        nbuf[1] = 0;
+        argv[argc++] = "-j";
+        argv[argc++] = nbuf;
+    }
+    argv[argc++] = ROOT;
+    argv[argc++] = "target";
+    argv[argc] = 0;
+
+    int pid = fork();
+    if (pid < 0) {
+        fprintf(2, "findbench: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        close(1);
+        if (open(OUT, O_CREATE | O_TRUNC | O_WRONLY) != 1) {
+            fprintf(2, "findbench: cannot create %s\n", OUT);
+            exit(1);
+        }
+        exec("find", argv);
+        fprintf(2, "findbench: exec find failed\n");
+        exit(1);
+    }
+    wait(0);
+
+    int fd = open(OUT, O_RDONLY);
+    lines = 0;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        for (int i = 0; i < n; i++)
+            lines += buf[i] == '\n';
+    }
+    close(fd);
+    return lines;
+}
+
+/**
+ * Build a wide tree and time find walking it serially and with
+ * 1, 2, 4 and 8 workers, checking that every walk finds every file.
+ */
+int main(int argc, char *argv[]) {
+    static int workers[] = {0, 1, 2, 4, 8};
+
+    build(ROOT, 0);
+    printf("tree: %d directories\n", ndirs);
+    for (int i = 0; i < sizeof(workers) / sizeof(workers[0]); i++) {
+        int t0 = uptime();
+        for (int r = 0; r < ROUNDS; r++) {
+            int found = walk(workers[i]);
+            if (found != ndirs) {
+                fprintf(2, "findbench: found %d files, want %d\n", found, ndirs);
+                exit(1);
+            }
+        }
+        int t1 = uptime();
+        if (workers[i] == 0)
+            printf("serial: %d ticks for %d walks\n", t1 - t0, ROUNDS);
+        else
+            printf("%d workers: %d ticks for %d walks\n", workers[i], t1 - t0, ROUNDS);
+    }
+    unlink(OUT);
+    destroy(ROOT, 0);
+    exit(0);
+}
@@ -0,0 +1,112 @@
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define NITER 20000        // lock acquisitions per thread
+#define MAXT 8
+#define HZ 10000000        // utime() counts at 10MHz on qemu
+
+static char stacks[MAXT][PGSIZE];
+static int counter;
+
+static struct mutex mutex;
+static int spin;
+static int tokenfd[2];     // a pipe holding one byte while the lock is free
+
+static void spinlock(void) {
+    while (__atomic_exchange_n(&spin, 1, __ATOMIC_ACQUIRE) != 0)
+        ;
+}
+
+static void spinunlock(void) {
+    __atomic_store_n(&spin, 0, __ATOMIC_RELEASE);
+}
+
+static void mutexlock(void) {
+    mutex_lock(&mutex);
+}
+
+static void mutexunlock(void) {
+    mutex_unlock(&mutex);
+}
+
+static void pipelock(void) {
+    char c;
+    if (read(tokenfd[0], &c, 1) != 1)
+        exit(1);
+}
+
+static void pipeunlock(void) {
+    if (write(tokenfd[1], "t", 1) != 1)
+        exit(1);
+}
+
+struct lockops {
+    char *name;
+    void (*lock)(void);
+    void (*unlock)(void);
+};
+
+static int worker(void *arg) {
+    struct lockops *ops = arg;
+
+    for (int i = 0; i < NITER; i++) {
+        ops->lock();
+        counter++;
+        ops->unlock();
+    }
+    return 0;
+}
+
+/**
+ * Have nthread threads each take and release the lock NITER
+ * times around a shared counter, and print how long it took.
+ */
+static void run(struct lockops *ops, int nthread) {
+    int tids[MAXT];
+
+    counter = 0;
+    uint64 t0 = utime();
+    for (int i = 0; i < nthread; i++) {
+        if ((tids[i] = thread_create(worker, ops, stacks[i], PGSIZE)) < 0) {
+            fprintf(2, "futexbench: thread_create failed\n");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < nthread; i++) {
+        if (join(tids[i], 0) != tids[i]) {
+            fprintf(2, "futexbench: join failed\n");
+            exit(1);
+        }
+    }
+    uint64 ms = (utime() - t0) / (HZ / 1000);
+    if (counter != nthread * NITER) {
+        fprintf(2, "futexbench: %s: counted %d, want %d\n", ops->name, counter, nthread * NITER);
+        exit(1);
+    }
+    printf("%s, %d threads: %l ms, %l acquisitions per second\n",
+           ops->name, nthread, ms, ms ? (uint64) nthread * NITER * 1000 / ms : 0);
+}
+
+/**
+ * Compare a futex mutex with a spin lock and with a lock made of
+ * a token passed through a pipe, as more threads contend for it.
+ */
+int main(int argc, char *argv[]) {
+    static struct lockops locks[] = {
+        {"spin ", spinlock, spinunlock},
+        {"mutex", mutexlock, mutexunlock},
+        {"pipe ", pipelock, pipeunlock},
+    };
+    static int nthreads[] = {1, 2, 4, 8};
+
+    mutex_init(&mutex);
+    if (pipe(tokenfd) < 0 || write(tokenfd[1], "t", 1) != 1) {
+        fprintf(2, "futexbench: pipe failed\n");
+        exit(1);
+    }
+    for (int i = 0; i < sizeof(locks) / sizeof(locks[0]); i++)
+        for (int j = 0; j < sizeof(nthreads) / sizeof(nthreads[0]); j++)
+            run(&locks[i], nthreads[j]);
+    exit(0);
+}
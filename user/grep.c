@@ -1,105 +1,411 @@
 // Simple grep.  Only supports ^ . * $ operators.
+//
+// The pattern is compiled once into a list of items. The longest
+// run of plain characters that every match must contain is found
+// in the buffer with Boyer-Moore-Horspool search, and only the
+// lines containing it are handed to the matcher. -c counts the
+// matching lines and -l lists the files that have one. With -j,
+// worker processes search the files and pipe their output back,
+// to be printed in argument order.
 
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "user/user.h"
 
-char buf[1024];
-int match(char*, char*);
+#define MAXRE 128   // items in a compiled pattern
+#define MAXJOBS 8
 
+// A compiled pattern.
+struct re {
+  int bol;          // anchored by ^
+  int eol;          // anchored by $
+  int n;            // items
+  struct {
+    char c;         // character to match, or '.' for any
+    char star;      // followed by *: zero or more of c
+  } item[MAXRE];
+  char lit[MAXRE];  // every match contains lit[0..nlit)
+  int nlit;
+  int plain;        // the pattern is just lit: a hit is a match
+  uchar skip[256];  // Horspool shift for each last character
+};
+
+// A worker's output for one file is a series of frames, each a
+// header and n bytes of output. The last frame has n == 0 and
+// the file's count of matching lines, or n < 0 if the file could
+// not be opened.
+struct frame {
+  int n;
+  int count;
+};
+
+char buf[16384];
+char obuf[1024];    // output not yet written
+int nobuf;
+int outfd = -1;     // a worker's pipe to the parent, or -1
+int cflag, lflag;
+
+// Write out what output() has buffered.
 void
-grep(char *pattern, int fd)
+flush(void)
+{
+  struct frame f;
+
+  if(nobuf == 0)
+    return;
+  if(outfd < 0)
+    write(1, obuf, nobuf);
+  else {
+    f.n = nobuf;
+    f.count = 0;
+    if(write(outfd, &f, sizeof(f)) != sizeof(f) || write(outfd, obuf, nobuf) != nobuf)
+      exit(1);
+  }
+  nobuf = 0;
+}
+
+void
+output(char *p, int n)
+{
+  int m;
+
+  while(n > 0){
+    if(nobuf == sizeof(obuf))
+      flush();
+    m = sizeof(obuf) - nobuf;
+    if(m > n)
+      m = n;
+    memmove(obuf + nobuf, p, m);
+    nobuf += m;
+    p += m;
+    n -= m;
+  }
+}
+
+int match(struct re*, char*);
+
+// Compile pattern into re. Returns -1 if it is too long.
+int
+compile(struct re *re, char *pattern)
+{
+  char *p;
+  int i, j, k;
+
+  memset(re, 0, sizeof(*re));
+  p = pattern;
+  if(*p == '^'){
+    re->bol = 1;
+    p++;
+  }
+  while(*p){
+    if(p[0] == '$' && p[1] == '\0'){
+      re->eol = 1;
+      break;
+    }
+    if(re->n == MAXRE)
+      return -1;
+    re->item[re->n].c = *p;
+    if(p[1] == '*'){
+      re->item[re->n].star = 1;
+      p += 2;
+    } else
+      p++;
+    re->n++;
+  }
+
+  // the longest run of items that each match one given character.
+  for(i = 0; i < re->n; i = j + 1){
+    for(j = i; j < re->n && !re->item[j].star && re->item[j].c != '.'; j++)
+      ;
+    if(j - i > re->nlit){
+      re->nlit = j - i;
+      for(k = 0; k < re->nlit; k++)
+        re->lit[k] = re->item[i+k].c;
+    }
+  }
+  re->plain = re->nlit == re->n && !re->bol && !re->eol;
+
+  for(i = 0; i < 256; i++)
+    re->skip[i] = re->nlit;
+  for(i = 0; i < re->nlit - 1; i++)
+    re->skip[(uchar)re->lit[i]] = re->nlit - 1 - i;
+  return 0;
+}
+
+// Find the first occurrence of re's literal in [s, end).
+char*
+search(struct re *re, char *s, char *end)
+{
+  char c, last;
+
+  last = re->lit[re->nlit-1];
+  while(s + re->nlit <= end){
+    c = s[re->nlit-1];
+    if(c == last && memcmp(s, re->lit, re->nlit - 1) == 0)
+      return s;
+    s += re->skip[(uchar)c];
+  }
+  return 0;
+}
+
+// Print, or just count, the lines in [p, end) that match re.
+// Each line ends with a newline, except perhaps the last.
+// Returns the number of matching lines.
+int
+scan(struct re *re, char *p, char *end)
+{
+  char *q, *x, c;
+  int n, ok;
+
+  n = 0;
+  while(p < end){
+    if(re->nlit > 0){
+      // skip to the first line that contains the literal.
+      if((x = search(re, p, end)) == 0)
+        break;
+      while(x > p && x[-1] != '\n')
+        x--;
+      p = x;
+    }
+    for(q = p; q < end && *q != '\n'; q++)
+      ;
+    c = *q;
+    *q = 0;
+    ok = re->plain || match(re, p);
+    *q = c;
+    if(ok){
+      n++;
+      if(lflag)
+        return n;
+      if(!cflag){
+        if(q < end)
+          output(p, q+1 - p);
+        else {
+          output(p, q - p);
+          output("\n", 1);
+        }
+      }
+    }
+    p = q+1;
+  }
+  return n;
+}
+
+// Returns the number of matching lines in fd.
+int
+grep(struct re *re, int fd)
 {
-  int n, m;
-  char *p, *q;
+  int n, m, count;
+  char *end;
 
   m = 0;
+  count = 0;
   while((n = read(fd, buf+m, sizeof(buf)-m-1)) > 0){
     m += n;
-    buf[m] = '\0';
-    p = buf;
-    while((q = strchr(p, '\n')) != 0){
-      *q = 0;
-      if(match(pattern, p)){
-        *q = '\n';
-        write(1, p, q+1 - p);
+    for(end = buf+m; end > buf && end[-1] != '\n'; end--)
+      ;
+    if(end == buf){
+      if(m < sizeof(buf)-1)
+        continue;
+      end = buf+m;  // a line longer than buf: take it in pieces
+    }
+    count += scan(re, buf, end);
+    if(lflag && count)
+      return count;
+    m -= end - buf;
+    memmove(buf, end, m);
+  }
+  if(m > 0)
+    count += scan(re, buf, buf+m);  // last line has no newline
+  return count;
+}
+
+void
+report(char *name, int count, int many)
+{
+  flush();
+  if(lflag && count)
+    printf("%s\n", name);
+  else if(cflag && many)
+    printf("%s:%d\n", name, count);
+  else if(cflag)
+    printf("%d\n", count);
+}
+
+// Read exactly n bytes from a pipe. Returns -1 if it ends first.
+int
+readfull(int fd, void *p, int n)
+{
+  int i, r;
+
+  for(i = 0; i < n; i += r){
+    if((r = read(fd, (char*)p + i, n - i)) <= 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Search files[0..nfile) with njob worker processes. Worker j
+// searches files j, j+njob, ... and sends its output in frames
+// on its own pipe; the parent copies it out in argument order.
+void
+grepjobs(struct re *re, char **files, int nfile, int njob)
+{
+  int fds[MAXJOBS], p[2], i, j, fd;
+  struct frame f;
+
+  for(j = 0; j < njob; j++){
+    if(pipe(p) < 0){
+      fprintf(2, "grep: pipe failed\n");
+      exit(1);
+    }
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "grep: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(p[0]);
+      for(i = 0; i < j; i++)
+        close(fds[i]);
+      outfd = p[1];
+      for(i = j; i < nfile; i += njob){
+        f.n = -1;
+        f.count = 0;
+        if((fd = open(files[i], 0)) >= 0){
+          f.count = grep(re, fd);
+          f.n = 0;
+          close(fd);
+          flush();
+        }
+        if(write(outfd, &f, sizeof(f)) != sizeof(f))
+          exit(1);
+      }
+      exit(0);
+    }
+    close(p[1]);
+    fds[j] = p[0];
+  }
+
+  for(i = 0; i < nfile; i++){
+    fd = fds[i % njob];
+    for(;;){
+      if(readfull(fd, &f, sizeof(f)) < 0){
+        fprintf(2, "grep: worker failed\n");
+        exit(1);
+      }
+      if(f.n <= 0)
+        break;
+      if(readfull(fd, buf, f.n) < 0){
+        fprintf(2, "grep: worker failed\n");
+        exit(1);
       }
-      p = q+1;
+      write(1, buf, f.n);
     }
-    if(m > 0){
-      m -= p - buf;
-      memmove(buf, p, m);
+    if(f.n < 0){
+      printf("grep: cannot open %s\n", files[i]);
+      exit(1);
     }
+    report(files[i], f.count, 1);
+  }
+  for(j = 0; j < njob; j++){
+    close(fds[j]);
+    wait(0);
   }
 }
 
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
-  char *pattern;
+  static struct re re;
+  int fd, i, njob;
 
-  if(argc <= 1){
-    fprintf(2, "usage: grep pattern [file ...]\n");
+  njob = 0;
+  for(i = 1; i < argc && argv[i][0] == '-'; i++){
+    if(strcmp(argv[i], "-c") == 0)
+      cflag = 1;
+    else if(strcmp(argv[i], "-l") == 0)
+      lflag = 1;
+    else if(strcmp(argv[i], "-j") == 0 && i+1 < argc)
+      njob = atoi(argv[++i]);
+    else
+      break;
+  }
+  if(i >= argc || argv[i][0] == '-' || njob < 0 || njob > MAXJOBS){
+    fprintf(2, "usage: grep [-c] [-l] [-j jobs] pattern [file ...]\n");
+    exit(1);
+  }
+  if(compile(&re, argv[i]) < 0){
+    fprintf(2, "grep: pattern too long\n");
     exit(1);
   }
-  pattern = argv[1];
+  i++;
 
-  if(argc <= 2){
-    grep(pattern, 0);
+  if(i >= argc){
+    report("(standard input)", grep(&re, 0), 0);
+    flush();
     exit(0);
   }
 
-  for(i = 2; i < argc; i++){
+  if(njob > argc - i)
+    njob = argc - i;
+  if(njob > 1){
+    grepjobs(&re, argv + i, argc - i, njob);
+    exit(0);
+  }
+
+  for(; i < argc; i++){
     if((fd = open(argv[i], 0)) < 0){
+      flush();
       printf("grep: cannot open %s\n", argv[i]);
       exit(1);
     }
-    grep(pattern, fd);
+    report(argv[i], grep(&re, fd), 1);
     close(fd);
   }
+  flush();
   exit(0);
 }
 
 // Regexp matcher from Kernighan & Pike,
-// The Practice of Programming, Chapter 9.
+// The Practice of Programming, Chapter 9,
+// working on a compiled pattern.
 
-int matchhere(char*, char*);
-int matchstar(int, char*, char*);
+int matchhere(struct re*, int, char*);
+int matchstar(struct re*, int, char*);
 
 int
-match(char *re, char *text)
+match(struct re *re, char *text)
 {
-  if(re[0] == '^')
-    return matchhere(re+1, text);
+  if(re->bol)
+    return matchhere(re, 0, text);
   do{  // must look at empty string
-    if(matchhere(re, text))
+    if(matchhere(re, 0, text))
       return 1;
   }while(*text++ != '\0');
   return 0;
 }
 
-// matchhere: search for re at beginning of text
-int matchhere(char *re, char *text)
+// matchhere: search for items i.. at beginning of text
+int matchhere(struct re *re, int i, char *text)
 {
-  if(re[0] == '\0')
-    return 1;
-  if(re[1] == '*')
-    return matchstar(re[0], re+2, text);
-  if(re[0] == '$' && re[1] == '\0')
-    return *text == '\0';
-  if(*text!='\0' && (re[0]=='.' || re[0]==*text))
-    return matchhere(re+1, text+1);
+  if(i == re->n)
+    return !re->eol || *text == '\0';
+  if(re->item[i].star)
+    return matchstar(re, i, text);
+  if(*text!='\0' && (re->item[i].c=='.' || re->item[i].c==*text))
+    return matchhere(re, i+1, text+1);
   return 0;
 }
 
-// matchstar: search for c*re at beginning of text
-int matchstar(int c, char *re, char *text)
+// matchstar: search for c* and items i+1.. at beginning of text
+int matchstar(struct re *re, int i, char *text)
 {
+  int c = re->item[i].c;
+
   do{  // a * matches zero or more instances
-    if(matchhere(re, text))
+    if(matchhere(re, i+1, text))
       return 1;
   }while(*text!='\0' && (*text++==c || c=='.'));
   return 0;
 }
-
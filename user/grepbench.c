@@ -0,0 +1,134 @@
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define MB (1024 * 1024)
+#define TOTAL (4 * MB)   // bytes of text fed to each grep
+#define CHUNK (64 * 1024)
+#define EVERY 1000       // one line in this many has the needle
+#define OUT "grepbench.out"
+
+static char text[CHUNK];
+static int textlen;      // whole lines in text
+static int nlines;       // lines in text
+static int nneedle;      // of them with the needle
+
+/**
+ * Fill text with numbered lines of filler words; every EVERY-th
+ * line also contains "needle".
+ */
+static void maketext(void) {
+    static char *words[] = {"alpha", "bravo", "charlie", "delta", "echo", "foxtrot"};
+    char line[128];
+    int i = 0;
+
+    for (;;) {
+        char *p = line;
+        for (int w = 0; w < 8; w++) {
+            char *s = words[(i + w * 7) % 6];
+            while (*s)
+                *p++ = *s++;
+            *p++ = ' ';
+        }
+        if (i % EVERY == EVERY - 1) {
+            strcpy(p, "needle ");
+            p += 7;
+        }
+        *p++ = '\n';
+        if (textlen + (p - line) > CHUNK)
+            break;
+        memmove(text + textlen, line, p - line);
+        textlen += p - line;
+        if (i % EVERY == EVERY - 1)
+            nneedle++;
+        nlines++;
+        i++;
+    }
+}
+
+/**
+ * Run grep with args on TOTAL bytes of text written to a pipe,
+ * and print how long it took.
+ * @return The output of grep -c, or -1 for other modes.
+ */
+static int run(char **args) {
+    int fds[2], n, count;
+    char buf[32];
+
+    if (pipe(fds) < 0) {
+        fprintf(2, "grepbench: pipe failed\n");
+        exit(1);
+    }
+    int t0 = uptime();
+    int pid = fork();
+    if (pid < 0) {
+        fprintf(2, "grepbench: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        close(0);
+        dup(fds[0]);
+        close(fds[0]);
+        close(fds[1]);
+        close(1);
+        if (open(OUT, O_CREATE | O_TRUNC | O_WRONLY) != 1) {
+            fprintf(2, "grepbench: cannot create %s\n", OUT);
+            exit(1);
+        }
+        exec("grep", args);
+        fprintf(2, "grepbench: exec grep failed\n");
+        exit(1);
+    }
+    close(fds[0]);
+    int reps = TOTAL / textlen;
+    for (int r = 0; r < reps; r++) {
+        if (write(fds[1], text, textlen) != textlen)
+            break;  // grep -l stops reading at the first match
+    }
+    close(fds[1]);
+    wait(0);
+    int t1 = uptime();
+
+    printf("grep");
+    for (char **a = args + 1; *a; a++)
+        printf(" %s", *a);
+    printf(": %d ticks for %d KB\n", t1 - t0, reps * textlen / 1024);
+
+    if (strcmp(args[1], "-c") != 0)
+        return -1;
+    int fd = open(OUT, O_RDONLY);
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    buf[n > 0 ? n : 0] = 0;
+    count = atoi(buf);
+    return count / reps;
+}
+
+/**
+ * Time grep over a few megabytes of text with a literal pattern and
+ * with patterns that only have a short literal in them, in printing,
+ * counting and listing modes. Counts are checked against the text.
+ */
+int main(int argc, char *argv[]) {
+    static char *tests[][4] = {
+        {"grep", "needle", 0},
+        {"grep", "-c", "needle", 0},
+        {"grep", "-c", "ne.dle", 0},
+        {"grep", "-c", "a.*o", 0},    // every line
+        {"grep", "-l", "needle", 0},
+    };
+
+    maketext();
+    for (int i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        int count = run(tests[i]);
+        if (count < 0)
+            continue;
+        int want = strcmp(tests[i][2], "a.*o") == 0 ? nlines : nneedle;
+        if (count != want) {
+            fprintf(2, "grepbench: counted %d lines, want %d\n", count, want);
+            exit(1);
+        }
+    }
+    unlink(OUT);
+    exit(0);
+}
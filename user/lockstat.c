@@ -0,0 +1,99 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/kstat.h"
+#include "user/user.h"
+
+#define NTOP 10
+#define NWORKER 4
+#define ROUNDS 2000
+
+static struct lockstat ls[NLOCKCLASS];
+
+/**
+ * Default workload: a few processes that allocate and free memory
+ * and push bytes through a pipe, which exercises the allocator,
+ * pipe, process and file locks from several CPUs at once.
+ */
+static void workload(void) {
+    for (int w = 0; w < NWORKER; w++) {
+        int pid = fork();
+        if (pid < 0) {
+            fprintf(2, "lockstat: fork failed\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            int fds[2];
+            char buf[64];
+            if (pipe(fds) < 0)
+                exit(1);
+            for (int r = 0; r < ROUNDS; r++) {
+                if (sbrk(4 * 4096) == (char *) -1)
+                    exit(1);
+                sbrk(-4 * 4096);
+                write(fds[1], buf, sizeof(buf));
+                read(fds[0], buf, sizeof(buf));
+            }
+            exit(0);
+        }
+    }
+    for (int w = 0; w < NWORKER; w++)
+        wait(0);
+}
+
+/**
+ * Run a command and wait for it to finish.
+ */
+static void run(char *argv[]) {
+    int pid = fork();
+    if (pid < 0) {
+        fprintf(2, "lockstat: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        exec(argv[0], argv);
+        fprintf(2, "lockstat: exec %s failed\n", argv[0]);
+        exit(1);
+    }
+    wait(0);
+}
+
+/**
+ * Usage: lockstat [command [args...]]
+ * Reset the kernel's spinlock statistics, run the command (or a built-in
+ * workload), and print the most contended locks.
+ */
+int main(int argc, char *argv[]) {
+    kstat(KSTAT_LOCK, 0, 0);
+    if (argc > 1)
+        run(argv + 1);
+    else
+        workload();
+
+    int n = kstat(KSTAT_LOCK, ls, sizeof(ls));
+    if (n < 0) {
+        fprintf(2, "lockstat: kstat failed\n");
+        exit(1);
+    }
+    n /= sizeof(ls[0]);
+
+    // selection sort by spin count, most contended first.
+    for (int i = 0; i < n; i++) {
+        int max = i;
+        for (int j = i + 1; j < n; j++) {
+            if (ls[j].nspin > ls[max].nspin)
+                max = j;
+        }
+        struct lockstat t = ls[i];
+        ls[i] = ls[max];
+        ls[max] = t;
+    }
+
+    printf("lock            acquires        contended       spins\n");
+    for (int i = 0; i < n && i < NTOP; i++) {
+        printf("%s", ls[i].name);
+        for (int k = strlen(ls[i].name); k < 16; k++)
+            printf(" ");
+        printf("%l\t\t%l\t\t%l\n", ls[i].nacquire, ls[i].ncontended, ls[i].nspin);
+    }
+    exit(0);
+}
@@ -0,0 +1,122 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/fcntl.h"
+#include "kernel/kstat.h"
+#include "user/user.h"
+
+#define NWORKER 4
+#define BIG (64 * 1024)
+
+static char buf[BIG];
+
+/**
+ * stressfs: each process appends 512-byte records to its own file.
+ */
+static void appends(int w) {
+    char path[] = "logbench0";
+    path[8] += w;
+    int fd = open(path, O_CREATE | O_RDWR | O_TRUNC);
+    for (int i = 0; i < 40; i++)
+        write(fd, buf, 512);
+    close(fd);
+    unlink(path);
+}
+
+/**
+ * Small rewrites of the same block, which commits can absorb.
+ */
+static void rewrites(int w) {
+    char path[] = "logbench0";
+    path[8] += w;
+    int fd = open(path, O_CREATE | O_RDWR | O_TRUNC);
+    for (int i = 0; i < 100; i++)
+        pwrite(fd, buf, 64, (i * 64) % 1024);
+    close(fd);
+    unlink(path);
+}
+
+/**
+ * Large sequential writes.
+ */
+static void bigwrites(int w) {
+    char path[] = "logbench0";
+    path[8] += w;
+    int fd = open(path, O_CREATE | O_RDWR | O_TRUNC);
+    for (int i = 0; i < 3; i++)
+        write(fd, buf, BIG);
+    close(fd);
+    unlink(path);
+}
+
+/**
+ * Creating and removing files, which writes inodes and directories.
+ */
+static void creates(int w) {
+    char path[] = "lb00";
+    path[2] += w;
+    for (int i = 0; i < 30; i++) {
+        path[3] = 'a' + i % 26;
+        close(open(path, O_CREATE | O_RDWR));
+        unlink(path);
+    }
+}
+
+/**
+ * Run f in NWORKER processes at once and print what the log did.
+ */
+static void run(char *name, void (*f)(int)) {
+    struct logstat ls;
+    struct diskstat ds;
+
+    kstat(KSTAT_LOG, 0, 0);
+    kstat(KSTAT_DISK, 0, 0);
+    int t0 = uptime();
+    for (int w = 0; w < NWORKER; w++) {
+        int pid = fork();
+        if (pid < 0) {
+            fprintf(2, "logbench: fork failed\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            f(w);
+            exit(0);
+        }
+    }
+    for (int w = 0; w < NWORKER; w++)
+        wait(0);
+    int t1 = uptime();
+    if (kstat(KSTAT_LOG, &ls, sizeof(ls)) != sizeof(ls) ||
+        kstat(KSTAT_DISK, &ds, sizeof(ds)) != sizeof(ds)) {
+        fprintf(2, "logbench: kstat failed\n");
+        exit(1);
+    }
+
+    uint64 writes = ls.nlogged + ls.nabsorbed;
+    printf("%s: %d ticks\n", name, t1 - t0);
+    printf("  ops %l (%l waited), commits %l (%l ticks, %l waited for flusher)\n",
+           ls.nop, ls.nwait, ls.ncommit, ls.committicks, ls.nflushwait);
+    printf("  blocks logged %l, absorbed %l (%l%%), per commit %l avg %l max\n",
+           ls.nlogged, ls.nabsorbed, writes ? ls.nabsorbed * 100 / writes : 0,
+           ls.ncommit ? ls.nlogged / ls.ncommit : 0, ls.maxcommit);
+    printf("  disk blocks %l in %l requests (%l merged), queue %l max\n",
+           ds.nblock, ds.nreq, ds.nmerged, ds.maxqueue);
+}
+
+/**
+ * Run stressfs-like workloads and print the log statistics for each:
+ * how many blocks were logged, how many writes were absorbed by blocks
+ * already in the transaction, how big and slow the commits were, and
+ * how many disk requests the scheduler merged the blocks into.
+ */
+int main(int argc, char *argv[]) {
+    struct logstat ls;
+
+    memset(buf, 'a', sizeof(buf));
+    kstat(KSTAT_LOG, &ls, sizeof(ls));
+    printf("log holds %l blocks\n", ls.size);
+    run("appends", appends);
+    run("rewrites", rewrites);
+    run("bigwrites", bigwrites);
+    run("creates", creates);
+    exit(0);
+}
@@ -0,0 +1,129 @@
+#include "kernel/types.h"
+#include "user/user.h"
+
+#define NSLOT 512
+#define STRESS_ROUNDS 200000
+#define BENCH_ROUNDS 100000
+
+static char *slot[NSLOT];
+static uint slotsize[NSLOT];
+static unsigned long seed = 1;
+
+static uint rnd(void) {
+    seed = seed * 1103515245 + 12345;
+    return (uint) (seed >> 16);
+}
+
+/**
+ * Pick an allocation size: mostly small, sometimes large.
+ */
+static uint pick_size(void) {
+    if (rnd() % 16 == 0)
+        return 4096 + rnd() % (64 * 1024);
+    return 1 + rnd() % 512;
+}
+
+/**
+ * Check that the block in slot i still holds the pattern written at allocation.
+ * @return 0 if intact, -1 otherwise.
+ */
+static int check_slot(int i) {
+    for (uint k = 0; k < slotsize[i]; k++) {
+        if (slot[i][k] != (char) (i + k))
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * Randomly allocate and free blocks of mixed sizes, verifying that no
+ * live block is ever overwritten by the allocator or another block.
+ */
+static void stress(void) {
+    char *top0 = sbrk(0);
+
+    for (int r = 0; r < STRESS_ROUNDS; r++) {
+        int i = rnd() % NSLOT;
+        if (slot[i]) {
+            if (check_slot(i) < 0) {
+                fprintf(2, "mallocbench: block %d corrupted\n", i);
+                exit(1);
+            }
+            free(slot[i]);
+            slot[i] = 0;
+        } else {
+            uint n = pick_size();
+            if ((slot[i] = malloc(n)) == 0) {
+                fprintf(2, "mallocbench: malloc(%d) failed\n", n);
+                exit(1);
+            }
+            if ((uint64) slot[i] % 16 != 0) {
+                fprintf(2, "mallocbench: misaligned block %p\n", slot[i]);
+                exit(1);
+            }
+            slotsize[i] = n;
+            for (uint k = 0; k < n; k++)
+                slot[i][k] = (char) (i + k);
+        }
+    }
+    for (int i = 0; i < NSLOT; i++) {
+        if (slot[i]) {
+            if (check_slot(i) < 0) {
+                fprintf(2, "mallocbench: block %d corrupted\n", i);
+                exit(1);
+            }
+            free(slot[i]);
+            slot[i] = 0;
+        }
+    }
+    printf("stress: %d rounds ok, heap grew %d bytes\n",
+           STRESS_ROUNDS, (int) (sbrk(0) - top0));
+}
+
+/**
+ * Time BENCH_ROUNDS malloc/free pairs of the given size, keeping
+ * a window of live blocks so the free lists are actually exercised.
+ */
+static void bench(uint size) {
+    int t0 = uptime();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        int i = r % NSLOT;
+        if (slot[i])
+            free(slot[i]);
+        slot[i] = malloc(size);
+    }
+    int t1 = uptime();
+    for (int i = 0; i < NSLOT; i++) {
+        free(slot[i]);
+        slot[i] = 0;
+    }
+    printf("bench: %d malloc/free of %d bytes: %d ticks\n", BENCH_ROUNDS, size, t1 - t0);
+}
+
+/**
+ * A large block freed at the top of the heap must be handed back to the kernel.
+ */
+static void trim(void) {
+    char *top0 = sbrk(0);
+    char *p = malloc(1024 * 1024);
+    if (p == 0) {
+        fprintf(2, "mallocbench: malloc(1MB) failed\n");
+        exit(1);
+    }
+    free(p);
+    if (sbrk(0) > top0) {
+        fprintf(2, "mallocbench: heap not trimmed after free\n");
+        exit(1);
+    }
+    printf("trim: ok\n");
+}
+
+int main(int argc, char *argv[]) {
+    stress();
+    trim();
+    bench(16);
+    bench(100);
+    bench(1000);
+    bench(8000);
+    exit(0);
+}
@@ -0,0 +1,41 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/kstat.h"
+#include "user/user.h"
+
+/**
+ * Print the kernel's physical memory allocator statistics: free memory,
+ * free blocks of each buddy order, and how fragmented the free memory is.
+ *
+ * Usage: memstat [-r]
+ *   -r  reset the allocation counters after printing them.
+ */
+int main(int argc, char *argv[]) {
+    struct memstat ms;
+
+    if (kstat(KSTAT_MEM, &ms, sizeof(ms)) != sizeof(ms)) {
+        fprintf(2, "memstat: kstat failed\n");
+        exit(1);
+    }
+
+    printf("pages: %l total, %l free (%l cached single pages)\n",
+           ms.npage, ms.nfree, ms.ncached);
+    printf("allocs: %l, failed: %l, splits: %l, merges: %l\n",
+           ms.nalloc, ms.nfail, ms.nsplit, ms.nmerge);
+
+    // A request for a block of order k can only be served from blocks of
+    // order k or higher; the rest of free memory is unusable for it.
+    printf("order  size(KB)  free blocks  unusable%%\n");
+    uint64 below = 0;
+    for (int k = 0; k <= MAXORDER; k++) {
+        uint64 unusable = ms.nfree ? below * 100 / ms.nfree : 0;
+        printf("%d\t%d\t  %l\t\t%l\n", k, 4 << k, ms.nblock[k], unusable);
+        below += ms.nblock[k] << k;
+        if (k == 0)
+            below += ms.ncached;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "-r") == 0)
+        kstat(KSTAT_MEM, 0, 0);
+    exit(0);
+}
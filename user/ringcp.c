@@ -0,0 +1,81 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/ring.h"
+#include "user/user.h"
+
+#define CHUNK 4096
+#define NBUF 16
+
+static char buf[NBUF][CHUNK];
+static struct ring *r;
+
+/**
+ * Queue one operation. The caller makes sure there is room.
+ */
+static void submit(int op, int fd, void *addr, int n, uint64 tag) {
+    struct ringsqe *sqe = &r->sq[r->sqtail % NRINGSQE];
+    sqe->op = op;
+    sqe->fd = fd;
+    sqe->addr = (uint64) addr;
+    sqe->n = n;
+    sqe->tag = tag;
+    r->sqtail++;
+}
+
+/**
+ * Copy src to dst, NBUF chunks per system call: each round queues a
+ * read of every chunk and a write of it, then runs them all at once.
+ */
+int main(int argc, char *argv[]) {
+    struct stat st;
+
+    if (argc != 3) {
+        fprintf(2, "usage: ringcp src dst\n");
+        exit(1);
+    }
+    int in = open(argv[1], O_RDONLY);
+    if (in < 0 || fstat(in, &st) < 0) {
+        fprintf(2, "ringcp: cannot open %s\n", argv[1]);
+        exit(1);
+    }
+    int out = open(argv[2], O_CREATE | O_WRONLY | O_TRUNC);
+    if (out < 0) {
+        fprintf(2, "ringcp: cannot create %s\n", argv[2]);
+        exit(1);
+    }
+    if ((r = ringsetup()) == (struct ring *) -1) {
+        fprintf(2, "ringcp: ringsetup failed\n");
+        exit(1);
+    }
+
+    uint left = st.size;
+    int calls = 0;
+    while (left > 0) {
+        int nop = 0;
+        for (int k = 0; k < NBUF && left > 0; k++) {
+            int n = left < CHUNK ? left : CHUNK;
+            submit(RING_READ, in, buf[k], n, n);
+            submit(RING_WRITE, out, buf[k], n, n);
+            nop += 2;
+            left -= n;
+        }
+        if (ringenter(nop) != nop) {
+            fprintf(2, "ringcp: ringenter failed\n");
+            exit(1);
+        }
+        calls++;
+        while (r->cqhead != r->cqtail) {
+            struct ringcqe *cqe = &r->cq[r->cqhead % NRINGCQE];
+            if (cqe->res != (int) cqe->tag) {
+                fprintf(2, "ringcp: short read or write\n");
+                exit(1);
+            }
+            r->cqhead++;
+        }
+    }
+    close(in);
+    close(out);
+    printf("ringcp: %d bytes in %d ringenter calls\n", (int) st.size, calls);
+    exit(0);
+}
@@ -1,8 +1,11 @@
 // Shell.
 
 #include "kernel/types.h"
+#include "kernel/stat.h"
 #include "user/user.h"
 #include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "kernel/spawn.h"
 
 // Parsed command representation
 #define EXEC  1
@@ -52,17 +55,150 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+void freecmd(struct cmd*);
+
+//PAGEBREAK!
+// Builtin commands, which the shell runs itself rather than
+// forking and exec()ing a program. Each returns an exit status.
+
+int
+bcd(int argc, char **argv)
+{
+  if(argc != 2){
+    fprintf(2, "usage: cd dir\n");
+    return 1;
+  }
+  if(chdir(argv[1]) < 0){
+    fprintf(2, "cannot cd %s\n", argv[1]);
+    return 1;
+  }
+  return 0;
+}
+
+int
+becho(int argc, char **argv)
+{
+  int i;
+
+  for(i = 1; i < argc; i++){
+    write(1, argv[i], strlen(argv[i]));
+    if(i + 1 < argc){
+      write(1, " ", 1);
+    } else {
+      write(1, "\n", 1);
+    }
+  }
+  return 0;
+}
+
+int
+btrue(int argc, char **argv)
+{
+  return 0;
+}
+
+int
+bfalse(int argc, char **argv)
+{
+  return 1;
+}
+
+// test string, test -n|-z string, test -e|-f|-d file,
+// test s1 = s2, test s1 != s2.
+int
+btest(int argc, char **argv)
+{
+  struct stat st;
+
+  if(argc == 2)
+    return argv[1][0] == 0;
+  if(argc == 3){
+    if(strcmp(argv[1], "-n") == 0)
+      return argv[2][0] == 0;
+    if(strcmp(argv[1], "-z") == 0)
+      return argv[2][0] != 0;
+    if(strcmp(argv[1], "-e") == 0)
+      return stat(argv[2], &st) < 0;
+    if(strcmp(argv[1], "-f") == 0)
+      return stat(argv[2], &st) < 0 || st.type != T_FILE;
+    if(strcmp(argv[1], "-d") == 0)
+      return stat(argv[2], &st) < 0 || st.type != T_DIR;
+  }
+  if(argc == 4){
+    if(strcmp(argv[2], "=") == 0)
+      return strcmp(argv[1], argv[3]) != 0;
+    if(strcmp(argv[2], "!=") == 0)
+      return strcmp(argv[1], argv[3]) == 0;
+  }
+  fprintf(2, "test: bad expression\n");
+  return 2;
+}
+
+int
+bexit(int argc, char **argv)
+{
+  exit(argc > 1 ? atoi(argv[1]) : 0);
+  return 0;
+}
+
+struct builtin {
+  char *name;
+  int (*fn)(int, char**);
+} builtins[] = {
+  { "cd", bcd },
+  { "echo", becho },
+  { "true", btrue },
+  { "false", bfalse },
+  { "test", btest },
+  { "exit", bexit },
+};
+
+struct builtin*
+lookup(char *name)
+{
+  int i;
+
+  for(i = 0; i < sizeof(builtins)/sizeof(builtins[0]); i++)
+    if(strcmp(builtins[i].name, name) == 0)
+      return &builtins[i];
+  return 0;
+}
+
+int
+runbuiltin(struct builtin *b, struct execcmd *ecmd)
+{
+  int argc;
+
+  for(argc = 0; ecmd->argv[argc]; argc++)
+    ;
+  return b->fn(argc, ecmd->argv);
+}
+
+// Set once this process is the right side of a pipe. Its
+// exit ends the pipeline for the shell, so unless it exec()s
+// it must not exit before the left side has.
+int piperight;
+
+void
+pipeexit(int status)
+{
+  if(piperight)
+    while(wait(0) >= 0)
+      ;
+  exit(status);
+}
 
 // Execute cmd.  Never returns.
 void
 runcmd(struct cmd *cmd)
 {
-  int p[2];
+  int p[2], pid;
   struct backcmd *bcmd;
   struct execcmd *ecmd;
   struct listcmd *lcmd;
   struct pipecmd *pcmd;
   struct redircmd *rcmd;
+  struct builtin *b;
 
   if(cmd == 0)
     exit(1);
@@ -75,8 +211,11 @@ runcmd(struct cmd *cmd)
     ecmd = (struct execcmd*)cmd;
     if(ecmd->argv[0] == 0)
       exit(1);
+    if((b = lookup(ecmd->argv[0])) != 0)
+      pipeexit(runbuiltin(b, ecmd));
     exec(ecmd->argv[0], ecmd->argv);
     fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+    pipeexit(0);
     break;
 
   case REDIR:
@@ -91,13 +230,17 @@ runcmd(struct cmd *cmd)
 
   case LIST:
     lcmd = (struct listcmd*)cmd;
-    if(fork1() == 0)
+    if((pid = fork1()) == 0)
       runcmd(lcmd->left);
-    wait(0);
+    // the left side of a pipe may be a child too.
+    while(wait(0) != pid)
+      ;
     runcmd(lcmd->right);
     break;
 
   case PIPE:
+    // fork only the left side: this process becomes the right
+    // side, and its exit ends the pipeline for the shell.
     pcmd = (struct pipecmd*)cmd;
     if(pipe(p) < 0)
       panic("pipe");
@@ -108,17 +251,12 @@ runcmd(struct cmd *cmd)
       close(p[1]);
       runcmd(pcmd->left);
     }
-    if(fork1() == 0){
-      close(0);
-      dup(p[0]);
-      close(p[0]);
-      close(p[1]);
-      runcmd(pcmd->right);
-    }
+    close(0);
+    dup(p[0]);
     close(p[0]);
     close(p[1]);
-    wait(0);
-    wait(0);
+    piperight = 1;
+    runcmd(pcmd->right);
     break;
 
   case BACK:
@@ -141,10 +279,177 @@ getcmd(char *buf, int nbuf)
   return 0;
 }
 
+// If cmd is a builtin, perhaps with redirections, run it in
+// the shell's own process and return 0; otherwise return -1.
+int
+runhere(struct cmd *cmd)
+{
+  struct execcmd *ecmd;
+  struct redircmd *rcmd;
+  struct builtin *b;
+  int saved;
+
+  switch(cmd->type){
+  case EXEC:
+    ecmd = (struct execcmd*)cmd;
+    if(ecmd->argv[0] == 0)
+      return 0;
+    if((b = lookup(ecmd->argv[0])) == 0)
+      return -1;
+    runbuiltin(b, ecmd);
+    return 0;
+
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    for(cmd = rcmd->cmd; cmd->type == REDIR; cmd = ((struct redircmd*)cmd)->cmd)
+      ;
+    ecmd = (struct execcmd*)cmd;
+    if(cmd->type != EXEC || ecmd->argv[0] == 0 || lookup(ecmd->argv[0]) == 0)
+      return -1;
+    // point rcmd->fd at the file, and back again afterwards.
+    // fds below it are always open, so close() then dup()
+    // or open() reuses it.
+    if((saved = dup(rcmd->fd)) < 0){
+      fprintf(2, "dup failed\n");
+      return 0;
+    }
+    close(rcmd->fd);
+    if(open(rcmd->file, rcmd->mode) < 0)
+      fprintf(2, "open %s failed\n", rcmd->file);
+    else {
+      runhere(rcmd->cmd);
+      close(rcmd->fd);
+    }
+    dup(saved);
+    close(saved);
+    return 0;
+  }
+  return -1;
+}
+
+// Can cmd, or each command in a pipeline, be started with
+// spawn()? It must be a program rather than a builtin, with
+// few enough redirections to leave room for the pipe's actions.
+int
+spawnable(struct cmd *cmd)
+{
+  struct pipecmd *pcmd;
+  struct execcmd *ecmd;
+  int nredir;
+
+  if(cmd->type == PIPE){
+    pcmd = (struct pipecmd*)cmd;
+    return spawnable(pcmd->left) && spawnable(pcmd->right);
+  }
+  for(nredir = 0; cmd->type == REDIR; nredir++)
+    cmd = ((struct redircmd*)cmd)->cmd;
+  if(cmd->type != EXEC || nredir > MAXSPAWNACT-5)
+    return 0;
+  ecmd = (struct execcmd*)cmd;
+  return ecmd->argv[0] != 0 && lookup(ecmd->argv[0]) == 0;
+}
+
+// Start a spawnable command, its redirections turned into
+// actions after the nact already in acts. Returns the pid,
+// or -1.
+int
+spawncmd(struct cmd *cmd, struct spawnact *acts, int nact)
+{
+  struct redircmd *rcmd;
+  struct execcmd *ecmd;
+  int pid;
+
+  for(; cmd->type == REDIR; cmd = rcmd->cmd){
+    rcmd = (struct redircmd*)cmd;
+    acts[nact].op = SPAWN_OPEN;
+    acts[nact].fd = rcmd->fd;
+    acts[nact].mode = rcmd->mode;
+    acts[nact].path = rcmd->file;
+    nact++;
+  }
+  ecmd = (struct execcmd*)cmd;
+  if((pid = spawn(ecmd->argv[0], ecmd->argv, acts, nact)) < 0)
+    fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+  return pid;
+}
+
+void
+setact(struct spawnact *act, int op, int fd, int src)
+{
+  act->op = op;
+  act->fd = fd;
+  act->src = src;
+}
+
+// Start a spawnable pipeline, or single command, with its
+// standard input from in if in >= 0. Closes in. Returns the
+// number of processes started.
+int
+spawnpipe(struct cmd *cmd, int in)
+{
+  struct spawnact acts[MAXSPAWNACT];
+  struct pipecmd *pcmd;
+  int p[2], n, nact;
+
+  nact = 0;
+  if(in >= 0){
+    setact(&acts[nact++], SPAWN_DUP, 0, in);
+    setact(&acts[nact++], SPAWN_CLOSE, in, 0);
+  }
+  if(cmd->type != PIPE){
+    n = spawncmd(cmd, acts, nact) >= 0;
+    if(in >= 0)
+      close(in);
+    return n;
+  }
+
+  pcmd = (struct pipecmd*)cmd;
+  if(pipe(p) < 0)
+    panic("pipe");
+  setact(&acts[nact++], SPAWN_DUP, 1, p[1]);
+  setact(&acts[nact++], SPAWN_CLOSE, p[0], 0);
+  setact(&acts[nact++], SPAWN_CLOSE, p[1], 0);
+  n = spawncmd(pcmd->left, acts, nact) >= 0;
+  close(p[1]);
+  if(in >= 0)
+    close(in);
+  return n + spawnpipe(pcmd->right, p[0]);
+}
+
+// Run a command line. Builtins, and lists of them, run
+// without a fork; programs, and pipelines of them, are
+// started with spawn().
+void
+runline(struct cmd *cmd)
+{
+  struct listcmd *lcmd;
+  int n;
+
+  if(cmd == 0)
+    return;
+  if(cmd->type == LIST){
+    lcmd = (struct listcmd*)cmd;
+    runline(lcmd->left);
+    runline(lcmd->right);
+    return;
+  }
+  if(runhere(cmd) == 0)
+    return;
+  if(spawnable(cmd)){
+    for(n = spawnpipe(cmd, -1); n > 0; n--)
+      wait(0);
+    return;
+  }
+  if(fork1() == 0)
+    runcmd(cmd);
+  wait(0);
+}
+
 int
 main(void)
 {
   static char buf[100];
+  struct cmd *cmd;
   int fd;
 
   // Ensure that three file descriptors are open.
@@ -157,16 +462,9 @@ main(void)
 
   // Read and run input commands.
   while(getcmd(buf, sizeof(buf)) >= 0){
-    if(buf[0] == 'c' && buf[1] == 'd' && buf[2] == ' '){
-      // Chdir must be called by the parent, not the child.
-      buf[strlen(buf)-1] = 0;  // chop \n
-      if(chdir(buf+3) < 0)
-        fprintf(2, "cannot cd %s\n", buf+3);
-      continue;
-    }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
-    wait(0);
+    cmd = parsecmd(buf);
+    runline(cmd);
+    freecmd(cmd);
   }
   exit(0);
 }
@@ -256,9 +554,47 @@ backcmd(struct cmd *subcmd)
   cmd->cmd = subcmd;
   return (struct cmd*)cmd;
 }
+
+// Free the nodes of a parsed command. The strings
+// they point to are in the command line buffer.
+void
+freecmd(struct cmd *cmd)
+{
+  if(cmd == 0)
+    return;
+  switch(cmd->type){
+  case REDIR:
+    freecmd(((struct redircmd*)cmd)->cmd);
+    break;
+  case PIPE:
+    freecmd(((struct pipecmd*)cmd)->left);
+    freecmd(((struct pipecmd*)cmd)->right);
+    break;
+  case LIST:
+    freecmd(((struct listcmd*)cmd)->left);
+    freecmd(((struct listcmd*)cmd)->right);
+    break;
+  case BACK:
+    freecmd(((struct backcmd*)cmd)->cmd);
+    break;
+  }
+  free(cmd);
+}
 //PAGEBREAK!
 // Parsing
 
+int parseerr;  // the command line has a syntax error
+
+// Report a syntax error. The shell runs on; parsecmd()
+// returns 0 for the line.
+void
+syntax(char *msg)
+{
+  if(!parseerr)
+    fprintf(2, "%s\n", msg);
+  parseerr = 1;
+}
+
 char whitespace[] = " \t\r\n\v";
 char symbols[] = "<|>&;()";
 
@@ -331,11 +667,16 @@ parsecmd(char *s)
   struct cmd *cmd;
 
   es = s + strlen(s);
+  parseerr = 0;
   cmd = parseline(&s, es);
   peek(&s, es, "");
-  if(s != es){
+  if(s != es && !parseerr){
     fprintf(2, "leftovers: %s\n", s);
-    panic("syntax");
+    syntax("syntax");
+  }
+  if(parseerr){
+    freecmd(cmd);
+    return 0;
   }
   nulterminate(cmd);
   return cmd;
@@ -379,8 +720,10 @@ parseredirs(struct cmd *cmd, char **ps, char *es)
 
   while(peek(ps, es, "<>")){
     tok = gettoken(ps, es, 0, 0);
-    if(gettoken(ps, es, &q, &eq) != 'a')
-      panic("missing file for redirection");
+    if(gettoken(ps, es, &q, &eq) != 'a'){
+      syntax("missing file for redirection");
+      break;
+    }
     switch(tok){
     case '<':
       cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
@@ -405,8 +748,10 @@ parseblock(char **ps, char *es)
     panic("parseblock");
   gettoken(ps, es, 0, 0);
   cmd = parseline(ps, es);
-  if(!peek(ps, es, ")"))
-    panic("syntax - missing )");
+  if(!peek(ps, es, ")")){
+    syntax("syntax - missing )");
+    return cmd;
+  }
   gettoken(ps, es, 0, 0);
   cmd = parseredirs(cmd, ps, es);
   return cmd;
@@ -431,13 +776,17 @@ parseexec(char **ps, char *es)
   while(!peek(ps, es, "|)&;")){
     if((tok=gettoken(ps, es, &q, &eq)) == 0)
       break;
-    if(tok != 'a')
-      panic("syntax");
+    if(tok != 'a'){
+      syntax("syntax");
+      break;
+    }
+    if(argc >= MAXARGS-1){
+      syntax("too many args");
+      break;
+    }
     cmd->argv[argc] = q;
     cmd->eargv[argc] = eq;
     argc++;
-    if(argc >= MAXARGS)
-      panic("too many args");
     ret = parseredirs(ret, ps, es);
   }
   cmd->argv[argc] = 0;
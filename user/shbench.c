@@ -0,0 +1,94 @@
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NCMD 200           // commands in each script
+#define HZ 10000000        // utime() counts at 10MHz on qemu
+#define SCRIPT "shbench.sh"
+#define OUT "shbench.out"
+#define TMP "shbench.tmp"
+
+/**
+ * Write a script of NCMD commands, cycling through lines[].
+ */
+static void makescript(char **lines, int nlines) {
+    int fd = open(SCRIPT, O_CREATE | O_TRUNC | O_WRONLY);
+    if (fd < 0) {
+        fprintf(2, "shbench: cannot create %s\n", SCRIPT);
+        exit(1);
+    }
+    for (int i = 0; i < NCMD; i++) {
+        char *s = lines[i % nlines];
+        if (write(fd, s, strlen(s)) != strlen(s) || write(fd, "\n", 1) != 1) {
+            fprintf(2, "shbench: write failed\n");
+            exit(1);
+        }
+    }
+    close(fd);
+}
+
+/**
+ * Run sh on the script and print how many commands per second it ran.
+ */
+static void run(char *name, char **lines, int nlines) {
+    char *argv[] = {"sh", 0};
+
+    makescript(lines, nlines);
+    uint64 t0 = utime();
+    int pid = fork();
+    if (pid < 0) {
+        fprintf(2, "shbench: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        close(0);
+        if (open(SCRIPT, O_RDONLY) != 0) {
+            fprintf(2, "shbench: cannot open %s\n", SCRIPT);
+            exit(1);
+        }
+        close(1);
+        if (open(OUT, O_CREATE | O_TRUNC | O_WRONLY) != 1) {
+            fprintf(2, "shbench: cannot create %s\n", OUT);
+            exit(1);
+        }
+        exec("sh", argv);
+        fprintf(2, "shbench: exec sh failed\n");
+        exit(1);
+    }
+    wait(0);
+    uint64 t1 = utime();
+    uint64 ms = (t1 - t0) / (HZ / 1000);
+    printf("%s: %d commands in %l ms, %l per second\n",
+           name, NCMD, ms, ms ? NCMD * 1000 / ms : 0);
+}
+
+/**
+ * Time scripts of builtin commands, of programs, and of pipelines.
+ */
+int main(int argc, char *argv[]) {
+    static char *builtins[] = {
+        "echo hello > " TMP,
+        "true",
+        "test -f " TMP,
+        "cd .",
+        "false ; echo again",
+    };
+    static char *programs[] = {
+        "cat " TMP,
+        "wc " TMP,
+        "grep hello " TMP,
+    };
+    static char *pipelines[] = {
+        "cat " TMP " | wc",
+        "echo hello | grep hello",
+        "cat " TMP " | cat | cat",
+    };
+
+    run("builtins", builtins, sizeof(builtins) / sizeof(builtins[0]));
+    run("programs", programs, sizeof(programs) / sizeof(programs[0]));
+    run("pipelines", pipelines, sizeof(pipelines) / sizeof(pipelines[0]));
+    unlink(SCRIPT);
+    unlink(OUT);
+    unlink(TMP);
+    exit(0);
+}
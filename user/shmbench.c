@@ -0,0 +1,189 @@
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "kernel/futex.h"
+#include "user/user.h"
+
+#define MB (1024 * 1024)
+#define TOTAL (8 * MB)     // bytes sent through each channel
+#define CHUNK 512          // bytes per write
+#define RINGBYTES (8 * PGSIZE)
+#define HZ 10000000        // utime() counts at 10MHz on qemu
+
+// A single-producer, single-consumer byte ring in a shared
+// memory segment. head and tail count bytes ever written and
+// read. A side that finds the ring full or empty sets its
+// waiting flag, checks again, and sleeps on the other side's
+// counter with futex(); the other side wakes it after moving
+// its counter if the flag is set.
+struct ring {
+    uint head;
+    uint tail;
+    int waiting[2];        // producer, consumer
+    char buf[RINGBYTES];
+};
+
+enum { PRODUCER, CONSUMER };
+
+static char chunk[CHUNK];
+
+static void await(struct ring *r, int side, uint *counter, uint seen) {
+    __atomic_store_n(&r->waiting[side], 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(counter, __ATOMIC_SEQ_CST) == seen)
+        futex((int *) counter, FUTEX_WAIT, (int) seen);
+    __atomic_store_n(&r->waiting[side], 0, __ATOMIC_SEQ_CST);
+}
+
+static void advance(struct ring *r, int other, uint *counter, uint n) {
+    __atomic_store_n(counter, *counter + n, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->waiting[other], __ATOMIC_SEQ_CST))
+        futex((int *) counter, FUTEX_WAKE, 1);
+}
+
+static void ringwrite(struct ring *r, char *p, int n) {
+    while (n > 0) {
+        uint tail = __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST);
+        uint room = RINGBYTES - (r->head - tail);
+        if (room == 0) {
+            await(r, PRODUCER, &r->tail, tail);
+            continue;
+        }
+        uint off = r->head % RINGBYTES;
+        uint m = n;
+        if (m > room)
+            m = room;
+        if (m > RINGBYTES - off)
+            m = RINGBYTES - off;
+        memmove(r->buf + off, p, m);
+        advance(r, CONSUMER, &r->head, m);
+        p += m;
+        n -= m;
+    }
+}
+
+static int ringread(struct ring *r, char *p, int n) {
+    uint head;
+
+    while ((head = __atomic_load_n(&r->head, __ATOMIC_SEQ_CST)) == r->tail)
+        await(r, CONSUMER, &r->head, head);
+    uint off = r->tail % RINGBYTES;
+    uint m = head - r->tail;
+    if (m > n)
+        m = n;
+    if (m > RINGBYTES - off)
+        m = RINGBYTES - off;
+    memmove(p, r->buf + off, m);
+    advance(r, PRODUCER, &r->tail, m);
+    return m;
+}
+
+/**
+ * Add up the bytes the consumer received, to check them.
+ */
+static uint sum(char *p, int n) {
+    uint s = 0;
+    for (int i = 0; i < n; i++)
+        s += (uchar) p[i];
+    return s;
+}
+
+static void report(char *name, uint64 t0) {
+    uint64 ms = (utime() - t0) / (HZ / 1000);
+    printf("%s: %d KB in %l ms, %l KB per second\n",
+           name, TOTAL / 1024, ms, ms ? (uint64) TOTAL / 1024 * 1000 / ms : 0);
+}
+
+/**
+ * Send TOTAL bytes from a parent to a child through a pipe.
+ */
+static void viapipe(uint want) {
+    int fds[2];
+    char buf[CHUNK];
+
+    if (pipe(fds) < 0) {
+        fprintf(2, "shmbench: pipe failed\n");
+        exit(1);
+    }
+    uint64 t0 = utime();
+    int pid = fork();
+    if (pid < 0) {
+        fprintf(2, "shmbench: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        uint s = 0;
+        int n;
+        close(fds[1]);
+        while ((n = read(fds[0], buf, sizeof(buf))) > 0)
+            s += sum(buf, n);
+        exit(s != want);
+    }
+    close(fds[0]);
+    for (int i = 0; i < TOTAL / CHUNK; i++) {
+        if (write(fds[1], chunk, CHUNK) != CHUNK) {
+            fprintf(2, "shmbench: write failed\n");
+            exit(1);
+        }
+    }
+    close(fds[1]);
+    int xstatus;
+    wait(&xstatus);
+    if (xstatus != 0) {
+        fprintf(2, "shmbench: pipe data corrupted\n");
+        exit(1);
+    }
+    report("pipe", t0);
+}
+
+/**
+ * Send TOTAL bytes from a parent to a child through a ring in
+ * a shared memory segment, which the child inherits.
+ */
+static void viashm(uint want) {
+    int npages = (sizeof(struct ring) + PGSIZE - 1) / PGSIZE;
+    struct ring *r = shmat("shmbench", npages, 0);
+    char buf[CHUNK];
+
+    if (r == (struct ring *) -1) {
+        fprintf(2, "shmbench: shmat failed\n");
+        exit(1);
+    }
+    uint64 t0 = utime();
+    int pid = fork();
+    if (pid < 0) {
+        fprintf(2, "shmbench: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        uint s = 0;
+        for (int got = 0; got < TOTAL; ) {
+            int n = ringread(r, buf, sizeof(buf));
+            s += sum(buf, n);
+            got += n;
+        }
+        exit(s != want);
+    }
+    for (int i = 0; i < TOTAL / CHUNK; i++)
+        ringwrite(r, chunk, CHUNK);
+    int xstatus;
+    wait(&xstatus);
+    if (xstatus != 0) {
+        fprintf(2, "shmbench: shared memory data corrupted\n");
+        exit(1);
+    }
+    report("shm ", t0);
+    shmdt(r);
+}
+
+/**
+ * Compare the throughput of a pipe with that of a ring buffer
+ * in shared memory, sending the same bytes through each.
+ */
+int main(int argc, char *argv[]) {
+    for (int i = 0; i < CHUNK; i++)
+        chunk[i] = i * 7;
+    uint want = sum(chunk, CHUNK) * (TOTAL / CHUNK);
+
+    viapipe(want);
+    viashm(want);
+    exit(0);
+}
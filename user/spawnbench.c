@@ -0,0 +1,80 @@
+#include "kernel/types.h"
+#include "user/user.h"
+
+#define NLAUNCH 100
+#define HZ 10000000      // utime() counts at 10MHz on qemu
+#define MB (1024 * 1024)
+
+static char *childargv[] = {"spawnbench", "child", 0};
+
+static void forkexec(void) {
+    int pid = fork();
+    if (pid < 0) {
+        fprintf(2, "spawnbench: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        exec(childargv[0], childargv);
+        fprintf(2, "spawnbench: exec failed\n");
+        exit(1);
+    }
+}
+
+static void vforkexec(void) {
+    int pid = vfork();
+    if (pid < 0) {
+        fprintf(2, "spawnbench: vfork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        exec(childargv[0], childargv);
+        fprintf(2, "spawnbench: exec failed\n");
+        exit(1);
+    }
+}
+
+static void dospawn(void) {
+    if (spawn(childargv[0], childargv, 0, 0) < 0) {
+        fprintf(2, "spawnbench: spawn failed\n");
+        exit(1);
+    }
+}
+
+/**
+ * Launch and wait for NLAUNCH children with start(), and print
+ * how many launches per second that is.
+ */
+static void bench(char *name, void (*start)(void), int heapmb) {
+    uint64 t0 = utime();
+    for (int i = 0; i < NLAUNCH; i++) {
+        start();
+        wait(0);
+    }
+    uint64 ms = (utime() - t0) / (HZ / 1000);
+    printf("%s, %dMB heap: %d launches in %l ms, %l per second\n",
+           name, heapmb, NLAUNCH, ms, ms ? NLAUNCH * 1000 / ms : 0);
+}
+
+/**
+ * Compare fork()+exec() with vfork()+exec() and spawn(), from a small process and from
+ * one with a few megabytes of heap that fork() has to copy.
+ */
+int main(int argc, char *argv[]) {
+    if (argc > 1)
+        exit(0);  // a launched child
+
+    bench("fork+exec ", forkexec, 0);
+    bench("vfork+exec", vforkexec, 0);
+    bench("spawn     ", dospawn, 0);
+
+    char *p = sbrk(8 * MB);
+    if (p == (char *) -1) {
+        fprintf(2, "spawnbench: sbrk failed\n");
+        exit(1);
+    }
+    memset(p, 1, 8 * MB);
+    bench("fork+exec ", forkexec, 8);
+    bench("vfork+exec", vforkexec, 8);
+    bench("spawn     ", dospawn, 8);
+    exit(0);
+}
@@ -0,0 +1,99 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/riscv.h"
+#include "kernel/kstat.h"
+#include "user/user.h"
+
+#define MB (1024 * 1024)
+#define BIG (144 * MB)     // more than the 128MB of RAM
+#define HALF (80 * MB)     // two of these don't fit either
+
+/**
+ * Fill npages pages starting at a with a pattern that depends on
+ * each page's address and on tag.
+ */
+static void fill(char *a, int npages, int tag) {
+    for (int i = 0; i < npages; i++) {
+        uint64 *p = (uint64 *) (a + (uint64) i * PGSIZE);
+        p[0] = (uint64) p ^ tag;
+        p[PGSIZE / sizeof(uint64) - 1] = ~((uint64) p ^ tag);
+    }
+}
+
+/**
+ * Check the pattern written by fill(), visiting pages in order
+ * starting from page first, so that every pass evicts pages that
+ * are about to be needed again.
+ * @return 0 if every page is intact, -1 otherwise.
+ */
+static int check(char *a, int npages, int tag, int first) {
+    for (int k = 0; k < npages; k++) {
+        int i = (first + k) % npages;
+        uint64 *p = (uint64 *) (a + (uint64) i * PGSIZE);
+        if (p[0] != ((uint64) p ^ tag) || p[PGSIZE / sizeof(uint64) - 1] != ~((uint64) p ^ tag)) {
+            fprintf(2, "swaptest: page %d corrupted\n", i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Allocate size bytes, fill them, and check them a few times.
+ */
+static int run(int size, int tag) {
+    int npages = size / PGSIZE;
+    char *a = sbrk(size);
+    if (a == (char *) -1) {
+        fprintf(2, "swaptest: sbrk(%d) failed\n", size);
+        return -1;
+    }
+    fill(a, npages, tag);
+    for (int pass = 0; pass < 3; pass++) {
+        if (check(a, npages, tag, pass * npages / 3) < 0)
+            return -1;
+    }
+    // the working set is read through a system call too.
+    int fds[2];
+    char c;
+    if (pipe(fds) < 0 || write(fds[1], a + size - 1, 1) != 1 || read(fds[0], &c, 1) != 1
+        || c != a[size - 1]) {
+        fprintf(2, "swaptest: pipe copy failed\n");
+        return -1;
+    }
+    close(fds[0]);
+    close(fds[1]);
+    sbrk(-size);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    struct swapstat ss;
+
+    if (kstat(KSTAT_SWAP, &ss, sizeof(ss)) != sizeof(ss) || ss.nslot == 0) {
+        fprintf(2, "swaptest: no swap area\n");
+        exit(1);
+    }
+
+    printf("swaptest: one process, %d MB\n", BIG / MB);
+    if (run(BIG, 1) < 0)
+        exit(1);
+
+    printf("swaptest: two processes, %d MB each\n", HALF / MB);
+    int pid = fork();
+    if (pid < 0) {
+        fprintf(2, "swaptest: fork failed\n");
+        exit(1);
+    }
+    int ok = run(HALF, pid == 0 ? 2 : 3);
+    if (pid == 0)
+        exit(ok < 0);
+    int xstatus;
+    wait(&xstatus);
+    if (ok < 0 || xstatus != 0)
+        exit(1);
+
+    kstat(KSTAT_SWAP, &ss, sizeof(ss));
+    printf("swaptest: ok, %l pages swapped out, %l swapped in\n", ss.nout, ss.nin);
+    exit(0);
+}
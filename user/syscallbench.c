@@ -0,0 +1,31 @@
+#include "kernel/types.h"
+#include "user/user.h"
+
+#define ROUNDS 200000
+
+/**
+ * Time ROUNDS calls of f, in clock ticks.
+ */
+static int bench(int (*f)(void)) {
+    int t0 = uptime();
+    for (int i = 0; i < ROUNDS; i++)
+        f();
+    return uptime() - t0;
+}
+
+/**
+ * Compare the real getpid() and uptime() system calls with the versions
+ * that read the USYSCALL page.
+ */
+int main(int argc, char *argv[]) {
+    if (ugetpid() != getpid()) {
+        fprintf(2, "syscallbench: ugetpid %d != getpid %d\n", ugetpid(), getpid());
+        exit(1);
+    }
+    printf("%d calls each, in ticks:\n", ROUNDS);
+    printf("getpid   %d\n", bench(getpid));
+    printf("ugetpid  %d\n", bench(ugetpid));
+    printf("uptime   %d\n", bench(uptime));
+    printf("uuptime  %d\n", bench(uuptime));
+    exit(0);
+}
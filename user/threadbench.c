@@ -0,0 +1,90 @@
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define N (1024 * 1024)    // ints summed
+#define ROUNDS 10          // sums timed per setting
+#define MAXT 8
+#define HZ 10000000        // utime() counts at 10MHz on qemu
+
+static int *data;
+static char stacks[MAXT][PGSIZE];
+static uint64 partial[MAXT];
+
+struct slice {
+    int i;                 // which thread
+    int lo, hi;            // sums data[lo..hi)
+};
+
+static int sum(void *arg) {
+    struct slice *s = arg;
+    uint64 total = 0;
+
+    for (int r = 0; r < ROUNDS; r++)
+        for (int i = s->lo; i < s->hi; i++)
+            total += data[i];
+    partial[s->i] = total;
+    return 0;
+}
+
+/**
+ * Sum data ROUNDS times with nthread threads, each taking an
+ * equal slice, and print how long it took.
+ * @return The sum.
+ */
+static uint64 run(int nthread) {
+    struct slice slices[MAXT];
+    int tids[MAXT];
+    uint64 total = 0;
+
+    uint64 t0 = utime();
+    for (int i = 0; i < nthread; i++) {
+        slices[i].i = i;
+        slices[i].lo = (uint64) N * i / nthread;
+        slices[i].hi = (uint64) N * (i + 1) / nthread;
+        if ((tids[i] = thread_create(sum, &slices[i], stacks[i], PGSIZE)) < 0) {
+            fprintf(2, "threadbench: thread_create failed\n");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < nthread; i++) {
+        if (join(tids[i], 0) != tids[i]) {
+            fprintf(2, "threadbench: join failed\n");
+            exit(1);
+        }
+        total += partial[i];
+    }
+    uint64 ms = (utime() - t0) / (HZ / 1000);
+    printf("%d threads: %l ms for %d sums of %d ints\n", nthread, ms, ROUNDS, N);
+    return total;
+}
+
+/**
+ * Time a parallel sum over an array with 1, 2, 4 and 8 threads,
+ * which should speed up until there are more threads than CPUs,
+ * checking each result.
+ */
+int main(int argc, char *argv[]) {
+    static int nthreads[] = {1, 2, 4, 8};
+    uint64 want = 0;
+
+    data = (int *) sbrk(N * sizeof(int));
+    if (data == (int *) -1) {
+        fprintf(2, "threadbench: sbrk failed\n");
+        exit(1);
+    }
+    for (int i = 0; i < N; i++) {
+        data[i] = i % 1000;
+        want += data[i];
+    }
+    want *= ROUNDS;
+
+    for (int i = 0; i < sizeof(nthreads) / sizeof(nthreads[0]); i++) {
+        uint64 got = run(nthreads[i]);
+        if (got != want) {
+            fprintf(2, "threadbench: sum %l, want %l\n", got, want);
+            exit(1);
+        }
+    }
+    exit(0);
+}
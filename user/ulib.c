@@ -1,6 +1,8 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
 #include "user.h"
 
 char *
@@ -171,3 +173,64 @@ void *
 memcpy(void *dst, const void *src, uint n) {
   return memmove(dst, src, n);
 }
+
+/**
+ * The following read the USYSCALL page, which the kernel keeps up
+ * to date, instead of trapping into the kernel.
+ */
+static volatile struct usyscall *const usyscall = (struct usyscall *) USYSCALL;
+
+/**
+ * Same as getpid(), without a system call.
+ */
+int
+ugetpid(void) {
+  return usyscall->pid;
+}
+
+/**
+ * Same as uptime(), without a system call.
+ */
+int
+uuptime(void) {
+  return usyscall->ticks;
+}
+
+/**
+ * The CLINT mtime clock as of the last return from the kernel.
+ * It counts at 10MHz on qemu.
+ */
+uint64
+utime(void) {
+  return usyscall->time;
+}
+
+/**
+ * Where a thread_create() thread starts. Its function and
+ * argument are at the top of its stack.
+ */
+struct threadstart {
+  int (*fn)(void *);
+  void *arg;
+};
+
+static void
+threadstart(void *a) {
+  struct threadstart *ts = a;
+  exit(ts->fn(ts->arg));
+}
+
+/**
+ * Start a thread running fn(arg) on the size-byte stack at stack,
+ * in this process's memory. The thread exits with the value fn
+ * returns, which join() collects. Returns the thread's id, or -1.
+ */
+int
+thread_create(int (*fn)(void *), void *arg, void *stack, int size) {
+  struct threadstart *ts;
+
+  ts = (struct threadstart *) (((uint64) stack + size) & ~15L) - 1;
+  ts->fn = fn;
+  ts->arg = arg;
+  return clone(threadstart, ts, ts);
+}
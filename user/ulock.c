@@ -0,0 +1,89 @@
+#include "kernel/types.h"
+#include "kernel/futex.h"
+#include "user/user.h"
+
+// Mutexes and condition variables for threads.
+//
+// Both stay in user space when there is no contention: a mutex
+// is taken and released with one atomic instruction each, and
+// only a thread that finds it held sleeps in the kernel, with
+// futex(). The mutex follows Drepper, "Futexes Are Tricky"
+// (2011), mutex 2: its state is 0 when free, 1 when held, and 2
+// when held with threads perhaps sleeping on it, so an unlock
+// that finds 1 knows it need not call the kernel.
+//
+// A condition variable is a sequence number that each signal
+// bumps. A waiter sleeps only if the number is still the one it
+// read before releasing the mutex, so a signal in between is
+// never lost.
+
+void
+mutex_init(struct mutex *m) {
+  m->state = 0;
+}
+
+// Take m, sleeping until it is free, and mark it contended
+// so whoever releases it next wakes a sleeper.
+static void
+mutex_lockslow(struct mutex *m) {
+  while (__atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE) != 0)
+    futex(&m->state, FUTEX_WAIT, 2);
+}
+
+void
+mutex_lock(struct mutex *m) {
+  int c = 0;
+
+  if (__atomic_compare_exchange_n(&m->state, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return;
+  mutex_lockslow(m);
+}
+
+/**
+ * Take m if it is free. Returns 1 if it was taken, else 0.
+ */
+int
+mutex_trylock(struct mutex *m) {
+  int c = 0;
+
+  return __atomic_compare_exchange_n(&m->state, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+void
+mutex_unlock(struct mutex *m) {
+  if (__atomic_fetch_sub(&m->state, 1, __ATOMIC_RELEASE) != 1) {
+    __atomic_store_n(&m->state, 0, __ATOMIC_RELEASE);
+    futex(&m->state, FUTEX_WAKE, 1);
+  }
+}
+
+void
+cond_init(struct cond *c) {
+  c->seq = 0;
+}
+
+/**
+ * Release m and sleep until c is signalled, then take m again.
+ * Wakeups may be spurious, so callers re-check their condition.
+ */
+void
+cond_wait(struct cond *c, struct mutex *m) {
+  int seq = __atomic_load_n(&c->seq, __ATOMIC_RELAXED);
+
+  mutex_unlock(m);
+  futex(&c->seq, FUTEX_WAIT, seq);
+  // others may be waiting for m too.
+  mutex_lockslow(m);
+}
+
+void
+cond_signal(struct cond *c) {
+  __atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+  futex(&c->seq, FUTEX_WAKE, 1);
+}
+
+void
+cond_broadcast(struct cond *c) {
+  __atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+  futex(&c->seq, FUTEX_WAKE, 0x7fffffff);
+}
@@ -3,88 +3,204 @@
 #include "user/user.h"
 #include "kernel/param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Memory allocator for user programs.
+//
+// Small requests are served from power-of-two size classes.
+// Each class has its own free list, so malloc() and free() of
+// a small block just pop or push one list entry. Blocks of a
+// class are carved out of whole pages obtained with sbrk(),
+// and a freed block always goes back to the list of its class.
+//
+// Requests too big for the largest class are large blocks,
+// kept on a separate address-ordered free list in the style of
+// Kernighan and Ritchie, The C Programming Language, 2nd ed.,
+// Section 8.7, with neighbouring free blocks coalesced. When
+// the highest free large block ends at the top of the heap and
+// is big enough, it is given back to the kernel with a negative
+// sbrk().
 
 typedef long Align;
 
 union header {
   struct {
-    union header *ptr;
-    uint size;
+    union header *ptr;  // next block on a free list
+    uint size;          // size of this block, in Header units
   } s;
   Align x;
 };
 
 typedef union header Header;
 
-static Header base;
-static Header *freep;
+#define PAGE      4096
+#define NCLASS    8                        // small size classes
+#define MINUNITS  2                        // units in a class-0 block
+#define MAXSMALL  (MINUNITS << (NCLASS-1)) // units in the largest class
+#define TRIMSIZE  (32*PAGE)                // give back a free heap top this big
 
-void
-free(void *ap)
+static Header *bins[NCLASS]; // free small blocks, one list per class
+static Header *bigfree;      // free large blocks, sorted by address
+
+// Return the size class for a small block of nu units.
+static int
+sizeclass(uint nu)
 {
-  Header *bp, *p;
+  int c;
 
-  bp = (Header*)ap - 1;
-  for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
-    if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
-      break;
-  if(bp + bp->s.size == p->s.ptr){
-    bp->s.size += p->s.ptr->s.size;
-    bp->s.ptr = p->s.ptr->s.ptr;
-  } else
-    bp->s.ptr = p->s.ptr;
-  if(p + p->s.size == bp){
-    p->s.size += bp->s.size;
-    p->s.ptr = bp->s.ptr;
-  } else
-    p->s.ptr = bp;
-  freep = p;
+  for(c = 0; (MINUNITS << c) < nu; c++)
+    ;
+  return c;
 }
 
+// Grow the heap by at least nbytes, keeping the
+// returned memory aligned to a Header.
 static Header*
-morecore(uint nu)
+morecore(uint nbytes)
 {
   char *p;
-  Header *hp;
+  uint pad;
 
-  if(nu < 4096)
-    nu = 4096;
-  p = sbrk(nu * sizeof(Header));
+  pad = (-(uint64)sbrk(0)) & (sizeof(Header) - 1);
+  p = sbrk(pad + nbytes);
   if(p == (char*)-1)
     return 0;
-  hp = (Header*)p;
-  hp->s.size = nu;
-  free((void*)(hp + 1));
-  return freep;
+  return (Header*)(p + pad);
 }
 
-void*
-malloc(uint nbytes)
+// Carve a fresh page into blocks of class c.
+static int
+refill(int c)
 {
-  Header *p, *prevp;
-  uint nunits;
+  Header *hp;
+  uint nu, i;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
-  if((prevp = freep) == 0){
-    base.s.ptr = freep = prevp = &base;
-    base.s.size = 0;
+  if((hp = morecore(PAGE)) == 0)
+    return -1;
+  nu = MINUNITS << c;
+  for(i = 0; i + nu <= PAGE / sizeof(Header); i += nu){
+    hp[i].s.size = nu;
+    hp[i].s.ptr = bins[c];
+    bins[c] = &hp[i];
   }
-  for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
-    if(p->s.size >= nunits){
-      if(p->s.size == nunits)
-        prevp->s.ptr = p->s.ptr;
-      else {
-        p->s.size -= nunits;
+  return 0;
+}
+
+// Give the last free large block back to the kernel if it
+// sits at the top of the heap.
+static void
+trim(void)
+{
+  Header *p, *prev;
+  uint nbytes;
+
+  prev = 0;
+  for(p = bigfree; p && p->s.ptr; p = p->s.ptr)
+    prev = p;
+  if(p == 0)
+    return;
+  nbytes = p->s.size * sizeof(Header);
+  if(nbytes < TRIMSIZE || (char*)(p + p->s.size) != sbrk(0))
+    return;
+  if(prev)
+    prev->s.ptr = 0;
+  else
+    bigfree = 0;
+  sbrk(-(int)nbytes);
+}
+
+// Put large block bp on the free list, merging it with
+// the blocks on either side if they are free.
+static void
+bigrelease(Header *bp)
+{
+  Header *p, *prev;
+
+  prev = 0;
+  for(p = bigfree; p && p < bp; p = p->s.ptr)
+    prev = p;
+
+  if(p && bp + bp->s.size == p){
+    bp->s.size += p->s.size;
+    bp->s.ptr = p->s.ptr;
+  } else
+    bp->s.ptr = p;
+
+  if(prev && prev + prev->s.size == bp){
+    prev->s.size += bp->s.size;
+    prev->s.ptr = bp->s.ptr;
+  } else if(prev)
+    prev->s.ptr = bp;
+  else
+    bigfree = bp;
+}
+
+// Allocate a large block of nu units, first fit.
+static void*
+bigalloc(uint nu)
+{
+  Header *p, *prev;
+  uint nbytes;
+
+  for(;;){
+    prev = 0;
+    for(p = bigfree; p; prev = p, p = p->s.ptr){
+      if(p->s.size < nu)
+        continue;
+      if(p->s.size - nu <= MAXSMALL){
+        // Remainder too small to be worth keeping apart.
+        if(prev)
+          prev->s.ptr = p->s.ptr;
+        else
+          bigfree = p->s.ptr;
+      } else {
+        p->s.size -= nu;
         p += p->s.size;
-        p->s.size = nunits;
+        p->s.size = nu;
       }
-      freep = prevp;
       return (void*)(p + 1);
     }
-    if(p == freep)
-      if((p = morecore(nunits)) == 0)
-        return 0;
+
+    nbytes = (nu * sizeof(Header) + PAGE - 1) & ~(PAGE - 1);
+    if((p = morecore(nbytes)) == 0)
+      return 0;
+    p->s.size = nbytes / sizeof(Header);
+    bigrelease(p);
+  }
+}
+
+void
+free(void *ap)
+{
+  Header *bp;
+  int c;
+
+  if(ap == 0)
+    return;
+  bp = (Header*)ap - 1;
+  if(bp->s.size > MAXSMALL){
+    bigrelease(bp);
+    trim();
+    return;
   }
+  c = sizeclass(bp->s.size);
+  bp->s.ptr = bins[c];
+  bins[c] = bp;
+}
+
+void*
+malloc(uint nbytes)
+{
+  Header *p;
+  uint nunits;
+  int c;
+
+  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  if(nunits > MAXSMALL)
+    return bigalloc(nunits);
+
+  c = sizeclass(nunits);
+  if(bins[c] == 0 && refill(c) < 0)
+    return 0;
+  p = bins[c];
+  bins[c] = p->s.ptr;
+  return (void*)(p + 1);
 }
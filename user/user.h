@@ -1,5 +1,8 @@
 #include "kernel/types.h"
 struct stat;
+struct ring;
+struct iovec;
+struct spawnact;
 struct rtcdate;
 
 // system calls
@@ -24,6 +27,20 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int kstat(int, void*, int);
+struct ring* ringsetup(void);
+int ringenter(int);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
+int spawn(char*, char**, struct spawnact*, int);
+int vfork(void);
+int clone(void (*)(void*), void*, void*);
+int join(int, int*);
+int futex(int*, int, int);
+void* shmat(char*, int, void*);
+int shmdt(void*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -41,6 +58,26 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+int ugetpid(void);
+int uuptime(void);
+uint64 utime(void);
+int thread_create(int (*)(void*), void*, void*, int);
+
+// ulock.c
+struct mutex {
+  int state;  // 0 free, 1 held, 2 held and contended
+};
+struct cond {
+  int seq;    // bumped by each signal
+};
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+int mutex_trylock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
 
 
 
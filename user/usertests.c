@@ -7,6 +7,11 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/kstat.h"
+#include "kernel/ring.h"
+#include "kernel/uio.h"
+#include "kernel/spawn.h"
+#include "kernel/futex.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -2592,6 +2597,1072 @@ countfree()
   return n;
 }
 
+// grow the heap over a few 2MB-aligned chunks, which the kernel
+// maps with megapages, then fork, and shrink the heap to a point
+// inside a megapage.
+void
+megapages(char *s)
+{
+  char *a, *p, *top;
+  int pid, xstatus;
+
+  a = sbrk(0);
+  if(sbrk(SUPERPGROUNDUP((uint64)a) - (uint64)a + 3*SUPERPGSIZE) == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  top = sbrk(0);
+  for(p = a; p < top; p += PGSIZE)
+    *(uint64*)p = (uint64)p;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(p = a; p < top; p += PGSIZE){
+      if(*(uint64*)p != (uint64)p){
+        printf("%s: child sees wrong data at %p\n", s, p);
+        exit(1);
+      }
+      *(uint64*)p = 0;
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+
+  // cut the last megapage in half.
+  if(sbrk(-SUPERPGSIZE/2) == (char*)-1){
+    printf("%s: sbrk shrink failed\n", s);
+    exit(1);
+  }
+  top = sbrk(0);
+  for(p = a; p < top; p += PGSIZE){
+    if(*(uint64*)p != (uint64)p){
+      printf("%s: wrong data at %p\n", s, p);
+      exit(1);
+    }
+  }
+  sbrk(a - top);
+}
+
+// growing the heap past a 2MB boundary with 4KB pages and
+// shrinking it back leaves an empty level-0 page table, which
+// a megapage grown at the boundary must replace.
+void
+megaregrow(char *s)
+{
+  char *a, *b, *p;
+
+  a = sbrk(0);
+  b = (char*)SUPERPGROUNDUP((uint64)a);
+  if(sbrk(b - a + 4*PGSIZE) == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(p = b; p < b + 4*PGSIZE; p += PGSIZE)
+    *p = 1;
+  if(sbrk(-4*PGSIZE) == (char*)-1 || sbrk(SUPERPGSIZE) != b){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(p = b; p < b + SUPERPGSIZE; p += PGSIZE){
+    if(*p != 0){
+      printf("%s: regrown memory not zeroed at %p\n", s, p);
+      exit(1);
+    }
+    *p = 2;
+  }
+  sbrk(a - sbrk(0));
+}
+
+// kstat(KSTAT_MEM) should report consistent numbers, and
+// see the pages a process allocates and frees.
+void
+kstatmem(char *s)
+{
+  struct memstat m0, m1, m2;
+  uint64 n;
+  int k;
+  char *a;
+
+  if(kstat(KSTAT_MEM, &m0, sizeof(m0)) != sizeof(m0)){
+    printf("%s: kstat failed\n", s);
+    exit(1);
+  }
+  n = m0.ncached;
+  for(k = 0; k <= MAXORDER; k++)
+    n += m0.nblock[k] << k;
+  if(n != m0.nfree || m0.nfree > m0.npage){
+    printf("%s: inconsistent memstat, free %d blocks %d\n", s, m0.nfree, n);
+    exit(1);
+  }
+
+  a = sbrk(256*4096);
+  if(a == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  kstat(KSTAT_MEM, &m1, sizeof(m1));
+  if(m1.nfree + 256 > m0.nfree){
+    printf("%s: sbrk(1MB) took only %d pages\n", s, m0.nfree - m1.nfree);
+    exit(1);
+  }
+  sbrk(-256*4096);
+  kstat(KSTAT_MEM, &m2, sizeof(m2));
+  if(m2.nfree < m1.nfree + 256){
+    printf("%s: sbrk(-1MB) freed only %d pages\n", s, m2.nfree - m1.nfree);
+    exit(1);
+  }
+
+  if(kstat(KSTAT_MEM, &m1, 8) != 8 || kstat(-1, &m1, sizeof(m1)) != -1){
+    printf("%s: kstat size handling\n", s);
+    exit(1);
+  }
+}
+
+// kstat(KSTAT_LOCK) should count acquires of well-known locks.
+void
+lockstats(char *s)
+{
+  static struct lockstat ls[NLOCKCLASS];
+  int i, n;
+
+  kstat(KSTAT_LOCK, 0, 0);
+  getpid();
+  n = kstat(KSTAT_LOCK, ls, sizeof(ls));
+  if(n <= 0 || n % sizeof(ls[0]) != 0){
+    printf("%s: kstat returned %d\n", s, n);
+    exit(1);
+  }
+  for(i = 0; i < n / sizeof(ls[0]); i++)
+    if(strcmp(ls[i].name, "proc") == 0)
+      break;
+  if(i == n / sizeof(ls[0]) || ls[i].nacquire == 0){
+    printf("%s: no acquires of proc locks counted\n", s);
+    exit(1);
+  }
+  if(ls[i].ncontended > ls[i].nacquire){
+    printf("%s: more contended than total acquires\n", s);
+    exit(1);
+  }
+}
+
+// several processes reading through one shared file descriptor
+// must each get distinct parts of the file, even though the
+// readers share the inode lock.
+void
+sharedoff(char *s)
+{
+  enum { N = 4, NUM = 2000 };
+  int fd, i, pid, v, p[2];
+  int sum, total;
+
+  unlink("sharedoff");
+  fd = open("sharedoff", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NUM; i++){
+    if(write(fd, &i, sizeof(i)) != sizeof(i)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  fd = open("sharedoff", O_RDONLY);
+  if(fd < 0 || pipe(p) < 0){
+    printf("%s: open or pipe failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      sum = 0;
+      while(read(fd, &v, sizeof(v)) == sizeof(v))
+        sum += v;
+      write(p[1], &sum, sizeof(sum));
+      exit(0);
+    }
+  }
+  close(p[1]);
+  total = 0;
+  for(i = 0; i < N; i++){
+    if(read(p[0], &sum, sizeof(sum)) != sizeof(sum)){
+      printf("%s: reader died\n", s);
+      exit(1);
+    }
+    total += sum;
+  }
+  for(i = 0; i < N; i++)
+    wait(0);
+  close(p[0]);
+  close(fd);
+  unlink("sharedoff");
+  if(total != NUM * (NUM - 1) / 2){
+    printf("%s: readers saw overlapping or missing data\n", s);
+    exit(1);
+  }
+}
+
+// the USYSCALL page must agree with the system calls it stands
+// in for, and must not be writable.
+void
+usyscall(char *s)
+{
+  int pid, xstatus;
+
+  if(ugetpid() != getpid()){
+    printf("%s: ugetpid %d, getpid %d\n", s, ugetpid(), getpid());
+    exit(1);
+  }
+  if(uptime() - uuptime() > 1){
+    printf("%s: uuptime %d, uptime %d\n", s, uuptime(), uptime());
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(ugetpid() != getpid()){
+      printf("%s: child ugetpid %d, getpid %d\n", s, ugetpid(), getpid());
+      exit(1);
+    }
+    *(volatile int *)USYSCALL = 0;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: write to USYSCALL page did not fault\n", s);
+    exit(1);
+  }
+}
+
+// queue one operation on ring r.
+static void
+ringsubmit(struct ring *r, int op, int fd, uint64 addr, int n, uint64 tag)
+{
+  struct ringsqe *sqe;
+
+  sqe = &r->sq[r->sqtail % NRINGSQE];
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->addr = addr;
+  sqe->n = n;
+  sqe->tag = tag;
+  r->sqtail++;
+}
+
+// queue write, close, open, read and close on a submission
+// ring and run them with one ringenter().
+void
+ringops(char *s)
+{
+  struct ring *r;
+  char data[] = "ring data";
+  char back[sizeof(data)];
+  int i, fd, res[5];
+
+  unlink("ringfile");
+  if((r = ringsetup()) == (struct ring*)-1){
+    printf("%s: ringsetup failed\n", s);
+    exit(1);
+  }
+  ringsubmit(r, RING_OPEN, 0, (uint64)"ringfile", O_CREATE|O_WRONLY, 0);
+  if(ringenter(1) != 1 || (fd = r->cq[r->cqhead % NRINGCQE].res) < 0){
+    printf("%s: open on ring failed\n", s);
+    exit(1);
+  }
+  r->cqhead++;
+
+  // the second open gets fd again, since it is
+  // the lowest free descriptor once closed.
+  ringsubmit(r, RING_WRITE, fd, (uint64)data, sizeof(data), 1);
+  ringsubmit(r, RING_CLOSE, fd, 0, 0, 2);
+  ringsubmit(r, RING_OPEN, 0, (uint64)"ringfile", O_RDONLY, 3);
+  ringsubmit(r, RING_READ, fd, (uint64)back, sizeof(back), 4);
+  ringsubmit(r, RING_CLOSE, fd, 0, 0, 5);
+  if(ringenter(5) != 5){
+    printf("%s: ringenter did not run 5 operations\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 5; i++){
+    if(r->cqhead == r->cqtail || r->cq[r->cqhead % NRINGCQE].tag != i+1){
+      printf("%s: completion %d missing\n", s, i+1);
+      exit(1);
+    }
+    res[i] = r->cq[r->cqhead % NRINGCQE].res;
+    r->cqhead++;
+  }
+  if(res[0] != sizeof(data) || res[1] != 0 || res[2] != fd ||
+     res[3] != sizeof(back) || res[4] != 0){
+    printf("%s: unexpected results %d %d %d %d %d\n", s,
+           res[0], res[1], res[2], res[3], res[4]);
+    exit(1);
+  }
+  if(strcmp(back, data) != 0){
+    printf("%s: read back wrong data\n", s);
+    exit(1);
+  }
+
+  // an operation on a bad descriptor fails without
+  // stopping the ring.
+  ringsubmit(r, RING_READ, 99, (uint64)back, sizeof(back), 6);
+  ringsubmit(r, RING_NOP, 0, 0, 0, 7);
+  if(ringenter(2) != 2 || r->cq[r->cqhead % NRINGCQE].res != -1 ||
+     r->cq[(r->cqhead+1) % NRINGCQE].res != 0){
+    printf("%s: read of bad fd did not fail alone\n", s);
+    exit(1);
+  }
+  unlink("ringfile");
+}
+
+// RING_FSYNC waits for the log to commit the ring's writes,
+// while another process keeps ops of its own in flight.
+void
+ringfsync(char *s)
+{
+  struct ring *r;
+  struct logstat ls;
+  char buf[512];
+  int i, fd, pid, xstatus;
+
+  memset(buf, 'f', sizeof(buf));
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    fd = open("fsyncbusy", O_CREATE|O_WRONLY);
+    for(i = 0; i < 50; i++)
+      write(fd, buf, sizeof(buf));
+    close(fd);
+    exit(0);
+  }
+
+  if((r = ringsetup()) == (struct ring*)-1){
+    printf("%s: ringsetup failed\n", s);
+    exit(1);
+  }
+  if((fd = open("fsyncfile", O_CREATE|O_WRONLY)) < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  kstat(KSTAT_LOG, 0, 0);
+  for(i = 0; i < 10; i++){
+    ringsubmit(r, RING_WRITE, fd, (uint64)buf, sizeof(buf), 1);
+    ringsubmit(r, RING_FSYNC, fd, 0, 0, 2);
+    if(ringenter(2) != 2 || r->cq[r->cqhead % NRINGCQE].res != sizeof(buf) ||
+       r->cq[(r->cqhead+1) % NRINGCQE].res != 0){
+      printf("%s: write and fsync on ring failed\n", s);
+      exit(1);
+    }
+    r->cqhead += 2;
+  }
+  if(kstat(KSTAT_LOG, &ls, sizeof(ls)) != sizeof(ls) || ls.ncommit == 0){
+    printf("%s: fsync returned without a commit\n", s);
+    exit(1);
+  }
+  ringsubmit(r, RING_FSYNC, 99, 0, 0, 3);
+  if(ringenter(1) != 1 || r->cq[r->cqhead % NRINGCQE].res != -1){
+    printf("%s: fsync of bad fd did not fail\n", s);
+    exit(1);
+  }
+  close(fd);
+  wait(&xstatus);
+  unlink("fsyncfile");
+  unlink("fsyncbusy");
+  exit(xstatus);
+}
+
+// writev gathers, readv scatters, and pread/pwrite use
+// their own offset without moving the file's.
+void
+vectorio(char *s)
+{
+  struct iovec iov[3];
+  char hdr[4] = "HDR:", body[2000], tail[3] = "END";
+  char a[4], b[2000], c[3], buf[8];
+  int fd, i;
+
+  for(i = 0; i < sizeof(body); i++)
+    body[i] = 'a' + i % 26;
+  unlink("vectorio");
+  fd = open("vectorio", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = sizeof(hdr);
+  iov[1].iov_base = body;
+  iov[1].iov_len = sizeof(body);
+  iov[2].iov_base = tail;
+  iov[2].iov_len = sizeof(tail);
+  if(writev(fd, iov, 3) != sizeof(hdr) + sizeof(body) + sizeof(tail)){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+
+  // pwrite and pread do not move the file offset.
+  if(pwrite(fd, "hdr", 3, 0) != 3 || pread(fd, buf, 4, 0) != 4 ||
+     memcmp(buf, "hdr:", 4) != 0){
+    printf("%s: pwrite/pread at 0 failed\n", s);
+    exit(1);
+  }
+  if(pread(fd, buf, 8, sizeof(hdr) + sizeof(body)) != sizeof(tail) ||
+     memcmp(buf, tail, sizeof(tail)) != 0){
+    printf("%s: pread at end failed\n", s);
+    exit(1);
+  }
+  if(write(fd, "x", 1) != 1 || pread(fd, buf, 1, sizeof(hdr) + sizeof(body) + sizeof(tail)) != 1 ||
+     buf[0] != 'x'){
+    printf("%s: pwrite moved the file offset\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("vectorio", O_RDONLY);
+  iov[0].iov_base = a;
+  iov[0].iov_len = sizeof(a);
+  iov[1].iov_base = b;
+  iov[1].iov_len = sizeof(b);
+  iov[2].iov_base = c;
+  iov[2].iov_len = sizeof(c);
+  if(readv(fd, iov, 3) != sizeof(a) + sizeof(b) + sizeof(c)){
+    printf("%s: readv failed\n", s);
+    exit(1);
+  }
+  if(memcmp(a, "hdr:", 4) != 0 || memcmp(b, body, sizeof(body)) != 0 ||
+     memcmp(c, tail, sizeof(tail)) != 0){
+    printf("%s: readv returned wrong data\n", s);
+    exit(1);
+  }
+  // only the "x" is left.
+  if(readv(fd, iov, 3) != 1 || a[0] != 'x'){
+    printf("%s: readv at end of file failed\n", s);
+    exit(1);
+  }
+  if(readv(fd, iov, MAXIOV+1) != -1){
+    printf("%s: readv accepted too many buffers\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("vectorio");
+
+  // readv on a pipe spreads what is there across the buffers,
+  // and does not wait for more while the write end is open.
+  int fds[2];
+  if(pipe(fds) < 0 || write(fds[1], "abcdef", 6) != 6){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = a;
+  iov[0].iov_len = sizeof(a);
+  iov[1].iov_base = buf;
+  iov[1].iov_len = sizeof(buf);
+  if(readv(fds[0], iov, 2) != 6 || memcmp(a, "abcd", 4) != 0 || memcmp(buf, "ef", 2) != 0){
+    printf("%s: readv on a pipe failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// the log statistics must count the blocks a write logs, and
+// repeated writes to one block in a transaction are absorbed.
+void
+logstats(char *s)
+{
+  struct logstat ls;
+  char buf[BSIZE];
+  struct iovec iov[4];
+  int fd, i;
+
+  unlink("logstats");
+  fd = open("logstats", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'x', sizeof(buf));
+  kstat(KSTAT_LOG, 0, 0);
+  // four writes to the same block in one transaction.
+  for(i = 0; i < 4; i++){
+    iov[i].iov_base = buf;
+    iov[i].iov_len = 100;
+  }
+  if(writev(fd, iov, 4) != 400){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+  if(kstat(KSTAT_LOG, &ls, sizeof(ls)) != sizeof(ls)){
+    printf("%s: kstat failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("logstats");
+  if(ls.size < MAXOPBLOCKS || ls.nop == 0 || ls.ncommit == 0 || ls.nlogged == 0){
+    printf("%s: nothing counted\n", s);
+    exit(1);
+  }
+  if(ls.nabsorbed < 3){
+    printf("%s: only %d writes absorbed\n", s, (int)ls.nabsorbed);
+    exit(1);
+  }
+}
+
+// a large write's log blocks are consecutive on the disk, so
+// the I/O scheduler should send several of them in one request.
+void
+diskmerge(char *s)
+{
+  struct diskstat ds;
+  static char buf[16*BSIZE];
+  int fd;
+
+  unlink("diskmerge");
+  fd = open("diskmerge", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'm', sizeof(buf));
+  kstat(KSTAT_DISK, 0, 0);
+  if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  if(kstat(KSTAT_DISK, &ds, sizeof(ds)) != sizeof(ds)){
+    printf("%s: kstat failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("diskmerge");
+  if(ds.nreq == 0 || ds.nblock < 16){
+    printf("%s: nothing counted\n", s);
+    exit(1);
+  }
+  if(ds.nmerged == 0 || ds.nreq + ds.nmerged != ds.nblock){
+    printf("%s: %d blocks in %d requests, %d merged\n", s,
+           (int)ds.nblock, (int)ds.nreq, (int)ds.nmerged);
+    exit(1);
+  }
+}
+
+// writes of at most PIPEBUF bytes from several processes
+// must not be interleaved, even when the pipe fills up.
+void
+pipeatomic(char *s)
+{
+  enum { NWRITER = 4, NREC = 50 };
+  char buf[PIPEBUF];
+  int fds[2], i, j, n, r, pid, xstatus;
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NWRITER; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[0]);
+      memset(buf, 'a' + i, sizeof(buf));
+      for(j = 0; j < NREC; j++){
+        if(write(fds[1], buf, sizeof(buf)) != sizeof(buf)){
+          printf("%s: write failed\n", s);
+          exit(1);
+        }
+      }
+      exit(0);
+    }
+  }
+  close(fds[1]);
+  for(j = 0; j < NWRITER*NREC; j++){
+    for(n = 0; n < sizeof(buf); n += r){
+      if((r = read(fds[0], buf + n, sizeof(buf) - n)) <= 0){
+        printf("%s: short read\n", s);
+        exit(1);
+      }
+    }
+    for(i = 1; i < sizeof(buf); i++){
+      if(buf[i] != buf[0]){
+        printf("%s: writes interleaved\n", s);
+        exit(1);
+      }
+    }
+  }
+  close(fds[0]);
+  for(i = 0; i < NWRITER; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+}
+
+// spawn() starts a program with redirected descriptors,
+// and fails cleanly for a bad path or a bad action.
+void
+spawntest(char *s)
+{
+  struct spawnact act[2];
+  char *echoargv[] = { "echo", "spawned", 0 };
+  char buf[32];
+  int fds[2], pid, xstatus, n;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  act[0].op = SPAWN_DUP;
+  act[0].fd = 1;
+  act[0].src = fds[1];
+  act[1].op = SPAWN_CLOSE;
+  act[1].fd = fds[0];
+  if((pid = spawn("echo", echoargv, act, 2)) < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  close(fds[1]);
+  n = read(fds[0], buf, sizeof(buf)-1);
+  close(fds[0]);
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: wrong child\n", s);
+    exit(1);
+  }
+  if(n != 8 || memcmp(buf, "spawned\n", 8) != 0){
+    printf("%s: wrong output\n", s);
+    exit(1);
+  }
+
+  act[0].op = SPAWN_OPEN;
+  act[0].fd = 1;
+  act[0].mode = O_CREATE|O_WRONLY|O_TRUNC;
+  act[0].path = "spawntest";
+  if((pid = spawn("echo", echoargv, act, 1)) < 0){
+    printf("%s: spawn with open failed\n", s);
+    exit(1);
+  }
+  wait(0);
+  if((fds[0] = open("spawntest", O_RDONLY)) < 0 ||
+     read(fds[0], buf, sizeof(buf)) != 8 || memcmp(buf, "spawned\n", 8) != 0){
+    printf("%s: wrong output in file\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  unlink("spawntest");
+
+  if(spawn("nosuchprogram", echoargv, 0, 0) >= 0){
+    printf("%s: spawned a missing program\n", s);
+    exit(1);
+  }
+  act[0].op = SPAWN_DUP;
+  act[0].fd = 1;
+  act[0].src = NOFILE - 1;
+  if(spawn("echo", echoargv, act, 1) >= 0){
+    printf("%s: dup of a closed fd succeeded\n", s);
+    exit(1);
+  }
+  if(wait(0) != -1){
+    printf("%s: failed spawn left a child\n", s);
+    exit(1);
+  }
+}
+
+// a vfork() child shares the parent's memory, including
+// growth by sbrk(), until it calls exec() or exit().
+int vforkshared;
+
+void
+vforktest(char *s)
+{
+  char *echoargv[] = { "echo", "vforked", 0 };
+  char *top0, buf[16];
+  int pid, xstatus, fd;
+
+  vforkshared = 0;
+  top0 = sbrk(0);
+  pid = vfork();
+  if(pid < 0){
+    printf("%s: vfork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    vforkshared = getpid();
+    sbrk(PGSIZE);
+    exit(7);
+  }
+  if(vforkshared != pid){
+    printf("%s: child's write not seen\n", s);
+    exit(1);
+  }
+  if(sbrk(0) != top0 + PGSIZE){
+    printf("%s: child's sbrk not seen\n", s);
+    exit(1);
+  }
+  if(wait(&xstatus) != pid || xstatus != 7){
+    printf("%s: wrong exit status\n", s);
+    exit(1);
+  }
+
+  pid = vfork();
+  if(pid < 0){
+    printf("%s: vfork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(1);
+    if(open("vforktest", O_CREATE|O_WRONLY|O_TRUNC) != 1)
+      exit(1);
+    exec("echo", echoargv);
+    exit(1);
+  }
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: exec'd child failed\n", s);
+    exit(1);
+  }
+  if((fd = open("vforktest", O_RDONLY)) < 0 ||
+     read(fd, buf, sizeof(buf)) != 8 || memcmp(buf, "vforked\n", 8) != 0){
+    printf("%s: wrong output\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("vforktest");
+
+  // a vfork() child may not map a ring into the borrowed page
+  // table, whether or not the parent has one.
+  for(int i = 0; i < 2; i++){
+    pid = vfork();
+    if(pid < 0){
+      printf("%s: vfork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0)
+      exit(ringsetup() == (struct ring*)-1 ? 0 : 1);
+    if(wait(&xstatus) != pid || xstatus != 0){
+      printf("%s: vfork child set up a ring\n", s);
+      exit(1);
+    }
+    if(i == 0 && ringsetup() == (struct ring*)-1){
+      printf("%s: ringsetup failed\n", s);
+      exit(1);
+    }
+  }
+}
+
+// threads made by thread_create() share memory, including
+// growth by sbrk(), and hand their exit status to join().
+#define NTT 4
+char threadstacks[NTT][PGSIZE];
+int threadslots[NTT];
+char *threadtop;
+
+int
+threadfn(void *arg)
+{
+  int i = (int)(uint64)arg;
+
+  threadslots[i] = getpid();
+  if(i == 0)
+    threadtop = sbrk(PGSIZE);
+  return i + 10;
+}
+
+void
+threadtest(char *s)
+{
+  int tids[NTT], i, xstatus;
+  char *top0;
+
+  top0 = sbrk(0);
+  for(i = 0; i < NTT; i++){
+    threadslots[i] = 0;
+    tids[i] = thread_create(threadfn, (void*)(uint64)i, threadstacks[i], PGSIZE);
+    if(tids[i] < 0){
+      printf("%s: thread_create failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < NTT; i++){
+    if(join(tids[i], &xstatus) != tids[i] || xstatus != i + 10){
+      printf("%s: join %d failed\n", s, i);
+      exit(1);
+    }
+    if(threadslots[i] != tids[i]){
+      printf("%s: thread %d's write not seen\n", s, i);
+      exit(1);
+    }
+  }
+  if(threadtop != top0 || sbrk(0) != top0 + PGSIZE){
+    printf("%s: thread's sbrk not seen\n", s);
+    exit(1);
+  }
+  if(join(tids[0], 0) != -1 || wait(0) != -1){
+    printf("%s: joined a thread twice\n", s);
+    exit(1);
+  }
+  // with its threads joined, this is an ordinary process again.
+  if(ringsetup() == (struct ring*)-1){
+    printf("%s: ringsetup refused after join\n", s);
+    exit(1);
+  }
+
+  // wait() leaves threads to join(), and join() only takes threads.
+  int pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(0);
+  if(join(pid, 0) != -1 || wait(0) != pid){
+    printf("%s: join took a process\n", s);
+    exit(1);
+  }
+}
+
+// threads count under a mutex, and hand a token around
+// with a condition variable.
+#define NFT 4
+#define FTITERS 2000
+struct mutex ftmutex;
+struct cond ftcond;
+int ftcount, ftturn;
+
+int
+futexfn(void *arg)
+{
+  int i, me = (int)(uint64)arg;
+
+  for(i = 0; i < FTITERS; i++){
+    mutex_lock(&ftmutex);
+    ftcount++;
+    mutex_unlock(&ftmutex);
+  }
+  for(i = 0; i < 10; i++){
+    mutex_lock(&ftmutex);
+    while(ftturn % NFT != me)
+      cond_wait(&ftcond, &ftmutex);
+    ftturn++;
+    cond_broadcast(&ftcond);
+    mutex_unlock(&ftmutex);
+  }
+  return 0;
+}
+
+void
+futextest(char *s)
+{
+  int tids[NFT], i, xstatus, v = 5;
+
+  if(futex(&v, FUTEX_WAIT, 6) != -1 || futex(&v, FUTEX_WAKE, 1) != 0){
+    printf("%s: futex on an idle word misbehaved\n", s);
+    exit(1);
+  }
+  mutex_init(&ftmutex);
+  cond_init(&ftcond);
+  ftcount = ftturn = 0;
+  for(i = 0; i < NFT; i++){
+    tids[i] = thread_create(futexfn, (void*)(uint64)i, threadstacks[i], PGSIZE);
+    if(tids[i] < 0){
+      printf("%s: thread_create failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < NFT; i++){
+    if(join(tids[i], &xstatus) != tids[i] || xstatus != 0){
+      printf("%s: join failed\n", s);
+      exit(1);
+    }
+  }
+  if(ftcount != NFT*FTITERS || ftturn != NFT*10){
+    printf("%s: count %d turn %d\n", s, ftcount, ftturn);
+    exit(1);
+  }
+}
+
+// a shared memory segment is seen by forked children and by
+// later attachments under its name, at chosen or picked
+// addresses, and is freed with its last attachment.
+void
+shmtest(char *s)
+{
+  int *a, *b, pid, xstatus;
+
+  a = shmat("usertests", 2, 0);
+  if(a == (int*)-1){
+    printf("%s: shmat failed\n", s);
+    exit(1);
+  }
+  if(a[0] != 0 || a[PGSIZE/sizeof(int)] != 0){
+    printf("%s: new segment not zeroed\n", s);
+    exit(1);
+  }
+  if(shmat("usertests", 3, 0) != (void*)-1 || shmat("other", 1, a) != (void*)-1 ||
+     shmat("other", 1, (void*)0xfffffffffffff000) != (void*)-1 ||
+     shmat("other", 2, (void*)(USHMEND - PGSIZE)) != (void*)-1 ||
+     shmat("other", 1, (void*)(USHM - PGSIZE)) != (void*)-1){
+    printf("%s: bad shmat succeeded\n", s);
+    exit(1);
+  }
+  a[0] = 42;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(a[0] != 42)
+      exit(1);
+    a[1] = 43;
+    // a second attachment, at a chosen address, sees the same pages.
+    b = (int*)((uint64)a + 16*PGSIZE);
+    if(shmat("usertests", 2, b) != b || b[0] != 42)
+      exit(1);
+    b[PGSIZE/sizeof(int)] = 44;
+    exit(0);
+  }
+  if(wait(&xstatus) != pid || xstatus != 0 || a[1] != 43 || a[PGSIZE/sizeof(int)] != 44){
+    printf("%s: child's writes not seen\n", s);
+    exit(1);
+  }
+  if(shmdt(a) != 0 || shmdt(a) != -1){
+    printf("%s: shmdt failed\n", s);
+    exit(1);
+  }
+
+  // the last attachment is gone, so this is a new segment.
+  if((a = shmat("usertests", 2, 0)) == (int*)-1 || a[0] != 0){
+    printf("%s: segment outlived its attachments\n", s);
+    exit(1);
+  }
+  shmdt(a);
+}
+
+// xargs splits more items than exec() takes into several
+// commands, each of which must run.
+void
+xargsmany(char *s)
+{
+  struct spawnact act[2];
+  char *argv[] = { "xargs", "echo", 0 };
+  char buf[256];
+  int fds[2], pid, xstatus, fd, n, i, nx;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < MAXARG + 8; i++)
+    write(fds[1], "x\n", 2);
+  close(fds[1]);
+  act[0].op = SPAWN_DUP;
+  act[0].fd = 0;
+  act[0].src = fds[0];
+  act[1].op = SPAWN_OPEN;
+  act[1].fd = 1;
+  act[1].mode = O_CREATE|O_WRONLY|O_TRUNC;
+  act[1].path = "xargsmany";
+  if((pid = spawn("xargs", argv, act, 2)) < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: xargs failed\n", s);
+    exit(1);
+  }
+  if((fd = open("xargsmany", O_RDONLY)) < 0){
+    printf("%s: no output\n", s);
+    exit(1);
+  }
+  nx = 0;
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    for(i = 0; i < n; i++)
+      nx += buf[i] == 'x';
+  close(fd);
+  unlink("xargsmany");
+  if(nx != MAXARG + 8){
+    printf("%s: echoed %d items, want %d\n", s, nx, MAXARG + 8);
+    exit(1);
+  }
+}
+
+// items of 127 bytes plus a terminator fill xargs' 2048-byte
+// batch exactly, so the 17th must start a new command.
+#define XFLEN 127
+#define XFITEMS 20
+void
+xargsfull(char *s)
+{
+  struct spawnact act[2];
+  char *argv[] = { "xargs", "echo", 0 };
+  char buf[XFLEN+1];
+  int pid, xstatus, fd, n, i, nx;
+
+  if((fd = open("xargsin", O_CREATE|O_WRONLY|O_TRUNC)) < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'x', XFLEN);
+  buf[XFLEN] = '\n';
+  for(i = 0; i < XFITEMS; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  act[0].op = SPAWN_OPEN;
+  act[0].fd = 0;
+  act[0].mode = O_RDONLY;
+  act[0].path = "xargsin";
+  act[1].op = SPAWN_OPEN;
+  act[1].fd = 1;
+  act[1].mode = O_CREATE|O_WRONLY|O_TRUNC;
+  act[1].path = "xargsout";
+  if((pid = spawn("xargs", argv, act, 2)) < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: xargs failed\n", s);
+    exit(1);
+  }
+  if((fd = open("xargsout", O_RDONLY)) < 0){
+    printf("%s: no output\n", s);
+    exit(1);
+  }
+  nx = 0;
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    for(i = 0; i < n; i++)
+      nx += buf[i] == 'x';
+  close(fd);
+  unlink("xargsin");
+  unlink("xargsout");
+  if(nx != XFLEN * XFITEMS){
+    printf("%s: echoed %d bytes, want %d\n", s, nx, XFLEN * XFITEMS);
+    exit(1);
+  }
+}
+
 // run each test in its own process. run returns 1 if child's exit()
 // indicates success.
 int
@@ -2639,6 +3710,25 @@ main(int argc, char *argv[])
     char *s;
   } tests[] = {
     {execout, "execout"},
+    {kstatmem, "kstatmem"},
+    {megapages, "megapages"},
+    {megaregrow, "megaregrow"},
+    {lockstats, "lockstats"},
+    {sharedoff, "sharedoff"},
+    {usyscall, "usyscall"},
+    {ringops, "ringops"},
+    {ringfsync, "ringfsync"},
+    {vectorio, "vectorio"},
+    {logstats, "logstats"},
+    {diskmerge, "diskmerge"},
+    {pipeatomic, "pipeatomic"},
+    {spawntest, "spawntest"},
+    {vforktest, "vforktest"},
+    {threadtest, "threadtest"},
+    {futextest, "futextest"},
+    {shmtest, "shmtest"},
+    {xargsmany, "xargsmany"},
+    {xargsfull, "xargsfull"},
     {copyin, "copyin"},
     {copyout, "copyout"},
     {copyinstr1, "copyinstr1"},
@@ -36,3 +36,17 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("kstat");
+entry("ringsetup");
+entry("ringenter");
+entry("readv");
+entry("writev");
+entry("pread");
+entry("pwrite");
+entry("spawn");
+entry("vfork");
+entry("clone");
+entry("join");
+entry("futex");
+entry("shmat");
+entry("shmdt");
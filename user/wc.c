@@ -2,10 +2,18 @@
 #include "kernel/stat.h"
 #include "user/user.h"
 
+#define MAXJOBS 8
+
 char buf[512];
 
+// What wc found in one file, sent from a worker to the parent.
+struct count {
+  int ok;      // 0 if the file could not be opened
+  int l, w, c;
+};
+
 void
-wc(int fd, char *name)
+count(int fd, struct count *ct)
 {
   int i, n;
   int l, w, c, inword;
@@ -29,19 +37,117 @@ wc(int fd, char *name)
     printf("wc: read error\n");
     exit(1);
   }
-  printf("%d %d %d %s\n", l, w, c, name);
+  ct->ok = 1;
+  ct->l = l;
+  ct->w = w;
+  ct->c = c;
+}
+
+void
+wc(int fd, char *name)
+{
+  struct count ct;
+
+  count(fd, &ct);
+  printf("%d %d %d %s\n", ct.l, ct.w, ct.c, name);
+}
+
+// Read exactly n bytes from a pipe. Returns -1 if it ends first.
+int
+readfull(int fd, void *p, int n)
+{
+  int i, r;
+
+  for(i = 0; i < n; i += r){
+    if((r = read(fd, (char*)p + i, n - i)) <= 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Count files[0..nfile) with njob worker processes. Worker j
+// counts files j, j+njob, ... and sends the results on its own
+// pipe; the parent prints them in argument order.
+void
+wcjobs(char **files, int nfile, int njob)
+{
+  int fds[MAXJOBS], p[2], i, j, fd;
+  struct count ct;
+
+  for(j = 0; j < njob; j++){
+    if(pipe(p) < 0){
+      printf("wc: pipe failed\n");
+      exit(1);
+    }
+    int pid = fork();
+    if(pid < 0){
+      printf("wc: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(p[0]);
+      for(i = 0; i < j; i++)
+        close(fds[i]);
+      for(i = j; i < nfile; i += njob){
+        memset(&ct, 0, sizeof(ct));
+        if((fd = open(files[i], 0)) >= 0){
+          count(fd, &ct);
+          close(fd);
+        }
+        if(write(p[1], &ct, sizeof(ct)) != sizeof(ct))
+          exit(1);
+      }
+      exit(0);
+    }
+    close(p[1]);
+    fds[j] = p[0];
+  }
+
+  for(i = 0; i < nfile; i++){
+    if(readfull(fds[i % njob], &ct, sizeof(ct)) < 0){
+      printf("wc: worker failed\n");
+      exit(1);
+    }
+    if(!ct.ok){
+      printf("wc: cannot open %s\n", files[i]);
+      exit(1);
+    }
+    printf("%d %d %d %s\n", ct.l, ct.w, ct.c, files[i]);
+  }
+  for(j = 0; j < njob; j++){
+    close(fds[j]);
+    wait(0);
+  }
 }
 
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  int fd, i, njob;
+
+  njob = 0;
+  if(argc > 2 && strcmp(argv[1], "-j") == 0){
+    njob = atoi(argv[2]);
+    if(njob < 1 || njob > MAXJOBS){
+      printf("usage: wc [-j jobs] [file ...]\n");
+      exit(1);
+    }
+    argv += 2;
+    argc -= 2;
+  }
 
   if(argc <= 1){
     wc(0, "");
     exit(0);
   }
 
+  if(njob > argc - 1)
+    njob = argc - 1;
+  if(njob > 1){
+    wcjobs(argv + 1, argc - 1, njob);
+    exit(0);
+  }
+
   for(i = 1; i < argc; i++){
     if((fd = open(argv[i], 0)) < 0){
       printf("wc: cannot open %s\n", argv[i]);
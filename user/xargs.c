@@ -1,66 +1,143 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
 #include "user.h"
 
-#define MAXARGS 10
+#define ARGBYTES 2048   // bytes of input items per command, well under the exec stack page
+#define MAXPROCS 16     // most -P job slots
 
-static char buf[512];
+static char inbuf[512];
+static int inpos, inlen;
+
+static char strbuf[ARGBYTES];
+static int nstr;
+static char *cmdargv[MAXARG + 1];
+static int nfixed;      // command words from our own arguments
+static int nitems;      // input items packed after them
+
+static int maxitems;    // items per command, from -n
+static int maxprocs = 1;
+static int running;     // children not yet waited for
+static int failed;
 
 /**
- * Run a specific task as specified in the run_task.
- * @param argc The number of arguments within the argv.
- * @param argv The arguments.
- * @return The result.
+ * Read the next character of standard input.
+ * @return The character, or -1 at end of input.
  */
-int run_task(int argc, char *argv[]) {
-    return -1;
+static int getch(void) {
+    if (inpos == inlen) {
+        inlen = read(0, inbuf, sizeof(inbuf));
+        inpos = 0;
+        if (inlen <= 0) {
+            inlen = 0;
+            return -1;
+        }
+    }
+    return (uchar) inbuf[inpos++];
 }
 
-int main(int argc, char *argv[]) {
-    if (argc == 1) {
-        fprintf(2, "Usage: xargs args...\n");
+static int isspace(int c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/**
+ * Wait for one child, noting whether it failed.
+ */
+static void reap(void) {
+    int status;
+
+    if (wait(&status) < 0) {
+        fprintf(2, "xargs: wait failed\n");
         exit(1);
     }
+    if (status != 0)
+        failed = 1;
+    running--;
+}
 
-    // Bulid the new args.
-    char *newargv[MAXARGS];
-    int newargc = 0;
-    for (int i = 1; i < argc; ++i) {
-        newargc += 1;
-        newargv[i - 1] = argv[i];
-    }
+/**
+ * Run the command with the items collected so far, once a job
+ * slot is free, then start collecting a new batch.
+ */
+static void launch(void) {
+    if (nitems == 0)
+        return;
+    while (running >= maxprocs)
+        reap();
+    cmdargv[nfixed + nitems] = 0;
+    if (spawn(cmdargv[0], cmdargv, 0, 0) < 0) {
+        fprintf(2, "xargs: exec %s failed\n", cmdargv[0]);
+        failed = 1;
+    } else
+        running++;
+    nitems = 0;
+    nstr = 0;
+}
 
-    // Build the original one.
-    while (readline(0, buf, 512) > 0) {
-        // The line is read into buf.
-        // Handle buf.
-        int pid = fork();
-        if (pid == 0) {
-            // handle the buf.
-            // find the args.
-            char *begin = buf;
-            char *p = buf;
-            while (1) {
-                if (*p == ' ') {
-                    *p = '\0';
-                    newargv[newargc] = begin;
-                    begin = p + 1;
-                    newargc += 1;
-                } else if (*p == '\n') {
-                    *p = '\0';
-                    newargv[newargc] = begin;
-                    begin = p + 1;
-                    newargc += 1;
-                    break;
-                }
-                p = p + 1;
-            }
+/**
+ * Read one whitespace-separated item into strbuf.
+ * @return Its start in strbuf, or 0 at end of input.
+ */
+static char *item(void) {
+    int c, start;
 
-            // Build args done.
-            exec(newargv[0], newargv);
-            fprintf(2, "Executed failed:%s\n", newargv[0]);
-            exit(1);
-        } else {
-            wait(0);
+    while ((c = getch()) >= 0 && isspace(c))
+        ;
+    if (c < 0)
+        return 0;
+    start = nstr;
+    for (; c >= 0 && !isspace(c); c = getch()) {
+        if (nstr >= ARGBYTES - 1) {
+            if (start == 0) {
+                fprintf(2, "xargs: argument too long\n");
+                exit(1);
+            }
+            // the batch is full: run it, then move this item to the start.
+            int n = nstr - start;
+            launch();
+            memmove(strbuf, strbuf + start, n);
+            start = 0;
+            nstr = n;
         }
+        strbuf[nstr++] = c;
+    }
+    strbuf[nstr++] = '\0';
+    return strbuf + start;
+}
+
+/**
+ * Run a command with items read from standard input appended to its
+ * arguments, packing as many items into each command as fit. With -P,
+ * keep up to that many commands running at once.
+ */
+int main(int argc, char *argv[]) {
+    int i;
+    char *s;
+
+    for (i = 1; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+        if (strcmp(argv[i], "-P") == 0)
+            maxprocs = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-n") == 0)
+            maxitems = atoi(argv[i + 1]);
+        else
+            break;
+    }
+    if (i == argc || argc - i >= MAXARG - 1 || maxprocs < 1 || maxprocs > MAXPROCS) {
+        fprintf(2, "Usage: xargs [-P procs] [-n items] command args...\n");
+        exit(1);
+    }
+    for (nfixed = 0; i < argc; i++)
+        cmdargv[nfixed++] = argv[i];
+    // exec() takes at most MAXARG - 1 arguments.
+    if (maxitems <= 0 || maxitems > MAXARG - 1 - nfixed)
+        maxitems = MAXARG - 1 - nfixed;
+
+    while ((s = item()) != 0) {
+        cmdargv[nfixed + nitems++] = s;
+        if (nitems == maxitems)
+            launch();
     }
-    exit(0);
+    launch();
+    while (running > 0)
+        reap();
+    exit(failed);
 }